@@ -0,0 +1,29 @@
+#!/bin/bash
+# Compare the membrane definitions of the single precision (-DTMDET_FLOAT32=ON)
+# and the double precision build on a set of cif files
+# usage: float-validation.sh <double binary> <float binary> <output dir> <cif files...>
+
+if [ $# -lt 4 ]; then
+    echo "usage: $0 <double binary> <float binary> <output dir> <cif files...>"
+    exit 1
+fi
+DOUBLE=$1
+FLOAT=$2
+OUT=$3
+shift 3
+mkdir -p "$OUT"
+
+total=0
+different=0
+for cif in "$@"; do
+    name=$(basename "$cif")
+    name=${name%%.*}
+    "$DOUBLE" -pi "$cif" -x "$OUT/$name.double.xml" -nc > /dev/null 2>&1 || continue
+    "$FLOAT" -pi "$cif" -x "$OUT/$name.float.xml" -nc -fv "$OUT/$name.double.xml" > "$OUT/$name.report" 2>&1
+    total=$((total+1))
+    if ! grep -q "result: SAME" "$OUT/$name.report"; then
+        different=$((different+1))
+        echo "$name: different"
+    fi
+done
+echo "structures: $total, different membrane definition: $different"
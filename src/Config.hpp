@@ -31,9 +31,16 @@
 
 #define DEFAULT_TMDET_MIN_NUMBER_OF_RESIDUES_IN_CHAIN "15"
 #define DEFAULT_TMDET_BALL_DIST "0.15"
+#define DEFAULT_TMDET_NORMAL_BLOCK "16"
 #define DEFAULT_TMDET_SURF_PROBSIZE "1.4"
 #define DEFAULT_TMDET_SURF_ZSLICE "0.05"
 #define DEFAULT_TMDET_SURF_DIST "0.1"
+#define DEFAULT_TMDET_SURF_ENGINE "LR"
+#define DEFAULT_TMDET_SURF_POINTS "1024"
+#define DEFAULT_TMDET_SURF_GRID "1.0"
+#define DEFAULT_TMDET_SURF_SYM_RMSD "0.5"
+#define DEFAULT_TMDET_SURF_SYM_SAMPLE "32"
+#define DEFAULT_TMDET_SURF_SYM_TOL "2.0"
 #define TMDET_TINY 1e-10
 #define TMDET_CURVED_MEMBRANE_MAX_HALFTHICKNESS 14
 #define TMDET_SECSTRVEC_MERGE_DIST 6.0
@@ -50,6 +57,17 @@ extern Tmdet::System::Environment environment;
 extern Tmdet::System::Logger logger;
 
 namespace Tmdet {
+
+    /**
+     * @brief floating point type of the surface and slice scoring kernels,
+     *        single precision if built with TMDET_FLOAT32
+     */
+#ifdef TMDET_FLOAT32
+    using real = float;
+#else
+    using real = double;
+#endif
+
     static std::vector<std::string> ANTIBODY_NAMES = {
         "ANTIBODY",
         "GLUEBODY",
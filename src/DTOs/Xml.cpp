@@ -5,6 +5,9 @@
 // License:    CC-BY-NC-4.0, see LICENSE.txt
 
 #include <string>
+#include <iostream>
+#include <algorithm>
+#include <math.h>
 #include <Config.hpp>
 #include <DTOs/Xml.hpp>
 #include <DTOs/XmlRW/Reader.hpp>
@@ -122,6 +125,66 @@ namespace Tmdet::DTOs {
             }
         }
 
+        bool Xml::compare(const std::string& xmlPath, const Tmdet::VOs::Protein& protein) {
+            if (!read(xmlPath)) {
+                return false;
+            }
+            Xml actual;
+            actual.fromProtein(protein);
+            const auto& ref = xmlData;
+            const auto& act = actual.xmlData;
+            bool same = (ref.tmp == act.tmp && ref.type.name == act.type.name);
+            std::cout << "Membrane definition compared to " << xmlPath << " (" << protein.code << ")" << std::endl;
+            std::cout << "  tmp: " << ref.tmp << " / " << act.tmp
+                << ", type: " << ref.type.name << " / " << act.type.name
+                << ", qValue: " << ref.qValue << " / " << act.qValue << std::endl;
+            //membrane normal is the third row of the rotation matrix
+            gemmi::Vec3 refNormal(ref.tmatrix.rot[2][0],ref.tmatrix.rot[2][1],ref.tmatrix.rot[2][2]);
+            gemmi::Vec3 actNormal(act.tmatrix.rot[2][0],act.tmatrix.rot[2][1],act.tmatrix.rot[2][2]);
+            double cosAngle = std::clamp(refNormal.dot(actNormal) / (refNormal.length() * actNormal.length() + TMDET_TINY),-1.0,1.0);
+            double angle = acos(std::abs(cosAngle)) * 180.0 / M_PI;
+            std::cout << "  normal angle: " << angle << " degree" << std::endl;
+            same = same && angle < 1.0;
+            if (ref.membranes.size() != act.membranes.size()) {
+                std::cout << "  number of membranes: " << ref.membranes.size() << " / " << act.membranes.size() << std::endl;
+                same = false;
+            }
+            for (unsigned long int i=0; i<std::min(ref.membranes.size(),act.membranes.size()); i++) {
+                double d = std::abs(ref.membranes[i].halfThickness - act.membranes[i].halfThickness);
+                std::cout << "  membrane " << i << " half thickness: " << ref.membranes[i].halfThickness
+                    << " / " << act.membranes[i].halfThickness << " (difference: " << d << ")" << std::endl;
+                same = same && d < 0.5;
+            }
+            int regionDiffs = 0;
+            for (const auto& refChain: ref.chains) {
+                auto actChain = std::find_if(act.chains.begin(), act.chains.end(),
+                    [&](const Tmdet::VOs::XmlChain& c) -> bool { return c.id == refChain.id; });
+                if (actChain == act.chains.end()) {
+                    continue;
+                }
+                if (refChain.regions.size() != actChain->regions.size()) {
+                    std::cout << "  chain " << refChain.id << " number of regions: " << refChain.regions.size()
+                        << " / " << actChain->regions.size() << std::endl;
+                    regionDiffs++;
+                    continue;
+                }
+                for (unsigned long int i=0; i<refChain.regions.size(); i++) {
+                    const auto& r1 = refChain.regions[i];
+                    const auto& r2 = actChain->regions[i];
+                    if (r1.beg.labelId != r2.beg.labelId || r1.end.labelId != r2.end.labelId || r1.type.code != r2.type.code) {
+                        std::cout << "  chain " << refChain.id << " region " << i << ": "
+                            << r1.beg.labelId << "-" << r1.end.labelId << " " << r1.type.code << " / "
+                            << r2.beg.labelId << "-" << r2.end.labelId << " " << r2.type.code << std::endl;
+                        regionDiffs++;
+                    }
+                }
+            }
+            std::cout << "  region boundary differences: " << regionDiffs << std::endl;
+            same = same && regionDiffs == 0;
+            std::cout << "  result: " << (same?"SAME":"DIFFERENT") << std::endl;
+            return same;
+        }
+
         std::string Xml::setPath(const std::string& code, const std::string& x1, const std::string& x2) const {
             if (code != "") {
                 return Tmdet::System::FilePaths::xml(code,true);
@@ -89,6 +89,17 @@ namespace Tmdet::DTOs {
              */
             void notTransmembrane(const std::string& xmlInputPath, const std::string& xmlOutputPath, const Tmdet::System::Arguments& args);
 
+            /**
+             * @brief compare the membrane definition of the protein with a
+             *        reference xml file (e.g. made by the double precision
+             *        build) and print the differences
+             * 
+             * @param xmlPath reference xml file
+             * @param protein 
+             * @return true if membrane definitions are the same
+             */
+            bool compare(const std::string& xmlPath, const Tmdet::VOs::Protein& protein);
+
             /**
              * @brief Set the file path
              * 
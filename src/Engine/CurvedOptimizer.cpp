@@ -17,10 +17,127 @@ namespace Tmdet::Engine {
         225, 250, 275, 300, 325, 350, 375, 400, 450, 500, 750, 1000, 2000
     };
 
+    //bracketing origos of the continuous sphere radius optimization
+    const std::vector<double> coarseOrigos = {
+        50, 100, 200, 400, 1000, 2000
+    };
+
     double CurvedOptimizer::distance(gemmi::Vec3& vec) {
         return origoVec3.dist(vec);
     }
 
+    void CurvedOptimizer::projectResidues() {
+        const Tmdet::real* x = residueCoords.x.data();
+        const Tmdet::real* y = residueCoords.y.data();
+        const Tmdet::real* z = residueCoords.z.data();
+        Tmdet::real* d = residueDistances.data();
+        const Tmdet::real ox = origoVec3.x;
+        const Tmdet::real oy = origoVec3.y;
+        const Tmdet::real oz = origoVec3.z;
+        const unsigned long int n = residueDistances.size();
+        for (unsigned long int i=0; i<n; i++) {
+            Tmdet::real dx = x[i] - ox;
+            Tmdet::real dy = y[i] - oy;
+            Tmdet::real dz = z[i] - oz;
+            d[i] = std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+    }
+
+    void CurvedOptimizer::testMembraneNormalProjected(const Tmdet::real* projection) {
+        testOrigos(projection);
+    }
+
+    double CurvedOptimizer::testOrigo(double o, const Tmdet::real* projection) {
+        double directionMaxQ = maxSliceQ;
+        maxSliceQ = -1.0;
+        setOrigo(-1.0 * o);
+        if (projection == nullptr) {
+            setDistances();
+        }
+        else {
+            //|p - (c + o*n)|^2 = |p - c|^2 - 2*o*(p - c)*n + o^2
+            const Tmdet::real* sqNorms = blockSqNorms.data();
+            Tmdet::real* d = residueDistances.data();
+            const Tmdet::real o1 = origo;
+            const unsigned long int n = residueDistances.size();
+            for (unsigned long int i=0; i<n; i++) {
+                Tmdet::real d2 = sqNorms[i] - 2 * o1 * projection[i] + o1 * o1;
+                d[i] = std::sqrt(d2>0?d2:Tmdet::real(0));
+            }
+            for (auto i: emptyResidues) {
+                residueDistances[i] = 0.0;
+            }
+        }
+        testMembraneNormalDistances();
+        double q = maxSliceQ;
+        maxSliceQ = std::max(directionMaxQ,q);
+        return q;
+    }
+
+    void CurvedOptimizer::testOrigos(const Tmdet::real* projection) {
+        if (!optimizeRadius) {
+            for (auto& o: origos) {
+                testOrigo(o,projection);
+            }
+            return;
+        }
+        double bestRadius = 0.0;
+        double bestScore = -1;
+        auto test = [&](double o) -> double {
+            double q = testOrigo(o,projection);
+            if (q > bestScore) {
+                bestScore = q;
+                bestRadius = o;
+            }
+            return q;
+        };
+        double a;
+        double b;
+        if (warmRadius > 0) {
+            //neighbouring normals have similar radius, so the bracket is
+            //set around the best radius of the previous normal
+            a = std::log(std::max(warmRadius / 2,coarseOrigos.front()));
+            b = std::log(std::min(warmRadius * 2,coarseOrigos.back()));
+        }
+        else {
+            //bracket the best radius with the coarse origos
+            unsigned long int best = 0;
+            double coarseScore = -1;
+            for (unsigned long int i=0; i<coarseOrigos.size(); i++) {
+                if (double q = test(coarseOrigos[i]); q > coarseScore) {
+                    coarseScore = q;
+                    best = i;
+                }
+            }
+            a = std::log(coarseOrigos[best>0?best-1:0]);
+            b = std::log(coarseOrigos[best+1<coarseOrigos.size()?best+1:best]);
+        }
+        //golden-section search in the bracket
+        //(on logarithmic scale, as the effect of radius is decreasing)
+        const double g = (std::sqrt(5.0) - 1.0) / 2.0;
+        double c = b - g * (b - a);
+        double d = a + g * (b - a);
+        double fc = test(std::exp(c));
+        double fd = test(std::exp(d));
+        for (int i=0; i<radiusIterations; i++) {
+            if (fc >= fd) {
+                b = d;
+                d = c;
+                fd = fc;
+                c = b - g * (b - a);
+                fc = test(std::exp(c));
+            }
+            else {
+                a = c;
+                c = d;
+                fc = fd;
+                d = a + g * (b - a);
+                fd = test(std::exp(d));
+            }
+        }
+        warmRadius = (bestScore > 0 ? bestRadius : 0.0);
+    }
+
     double CurvedOptimizer::getAngle(Tmdet::VOs::SecStrVec& vector) {
         gemmi::Vec3 vec = (vector.begin + vector.end) / 2;
         vec -= origoVec3;
@@ -28,19 +145,24 @@ namespace Tmdet::Engine {
     }
 
     void CurvedOptimizer::testMembraneNormal() {
-        for (auto& o: origos) {
-            origo = -1.0 * o;
-            origoVec3 = massCentre + origo * normal;
-            testMembraneNormalOne(); 
-        }
+        warmRadius = 0.0;
+        testOrigos(nullptr);
     }
 
     void CurvedOptimizer::testMembraneNormalFinal() {
-        origo = bestOrigo;
-        origoVec3 = massCentre + bestOrigo * normal;
+        setOrigo(bestOrigo);
         testMembraneNormalOne(); 
     }
 
+    std::unique_ptr<Optimizer> CurvedOptimizer::clone() const {
+        return std::make_unique<CurvedOptimizer>(*this);
+    }
+
+    void CurvedOptimizer::setOrigo(double o) {
+        origo = o;
+        origoVec3 = massCentre + origo * normal;
+    }
+
     void CurvedOptimizer::setBestOrigo(double minz, double maxz) {
         bestOrigo = origo;
         double mcz = distance(massCentre) - minZ;
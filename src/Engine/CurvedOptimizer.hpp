@@ -39,6 +39,23 @@ namespace Tmdet::Engine {
              */
             double bestSphereRadius;
 
+            /**
+             * @brief flag for optimizing the sphere radius continuously
+             *        instead of testing all origos of the table
+             */
+            bool optimizeRadius = false;
+
+            /**
+             * @brief number of golden-section iterations of radius optimization
+             */
+            int radiusIterations = 6;
+
+            /**
+             * @brief best sphere radius of the previous normal of the block
+             *        (0 if there is none), it brackets the radius optimization
+             */
+            double warmRadius = 0.0;
+
         protected:
             
             /**
@@ -49,10 +66,72 @@ namespace Tmdet::Engine {
              */
             double distance(gemmi::Vec3& vec);
 
+            /**
+             * @brief calculate the distance of every residue coordinate
+             *        in residueCoords into residueDistances
+             */
+            void projectResidues();
+
+            /**
+             * @brief calculate qValue using the projections of block evaluation
+             * 
+             * @param projection 
+             */
+            void testMembraneNormalProjected(const Tmdet::real* projection);
+
+            /**
+             * @brief calculate qValue for the actual normal and the given origo
+             * 
+             * @param o distance of the sphere centre from the mass centre
+             * @param projection projection of the residues from block evaluation
+             *        (distances are calculated from coordinates if it is nullptr)
+             * @return double maximal slice qValue
+             */
+            double testOrigo(double o, const Tmdet::real* projection);
+
+            /**
+             * @brief calculate qValue for the actual normal and all origos of
+             *        the table or the ones selected by radius optimization
+             * 
+             * @param projection 
+             */
+            void testOrigos(const Tmdet::real* projection);
+
             double getAngle(Tmdet::VOs::SecStrVec& vector);
 
             void testMembraneNormalFinal();
 
+            /**
+             * @brief create a copy of the optimizer for a worker thread
+             * 
+             * @return std::unique_ptr<Optimizer> 
+             */
+            std::unique_ptr<Optimizer> clone() const;
+
+            /**
+             * @brief get the actual centre of the sphere
+             * 
+             * @return double 
+             */
+            double getOrigo() const {
+                return origo;
+            }
+
+            /**
+             * @brief set the actual centre of the sphere
+             * 
+             * @param o 
+             */
+            void setOrigo(double o);
+
+            /**
+             * @brief reset the warm start of the radius optimization, so the
+             *        result does not depend on the blocks of other threads
+             */
+            void startBlock() {
+                warmRadius = 0.0;
+            }
+
             /**
              * @brief searcvh for the best sphere centre
              * 
@@ -82,6 +161,10 @@ namespace Tmdet::Engine {
             CurvedOptimizer(Tmdet::VOs::Protein& protein, Tmdet::System::Arguments& args) :
                 Optimizer(protein,args) {
                     type = "Curved";
+                    optimizeRadius = args.getValueAsBool("cro");
+                    //the golden-section search compares the qValues of origos
+                    pruning = pruning && !optimizeRadius;
+                    radiusIterations = args.getValueAsInt("cri");
                 }
             
             /**
@@ -24,6 +24,9 @@ namespace Tmdet::Engine {
         saveState();
         auto fragmentUtil = Tmdet::Utils::Fragment(protein);
         auto numFrags = fragmentUtil.run();
+        if (args.getValueAsBool("fc")) {
+            setSurfaceContacts();
+        }
         runOnFragments(numFrags);
         findClusters();
         runOnBestCluster(findBestCluster());
@@ -32,6 +35,16 @@ namespace Tmdet::Engine {
         }
     }
 
+    void Fragmenter::setSurfaceContacts() {
+        protein.eachResidue(
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                residue.selected = residue.temp.contains("fragment");
+            }
+        );
+        auto surf = Tmdet::Utils::Surface(protein,true,args.getValueAsInt("t"),false,
+            args.getValueAsString("se"),false,&contacts);
+    }
+
     void Fragmenter::runOnFragments(int numFragments) {
         for(int i=0; i<numFragments; i++) {
             protein.eachResidue(
@@ -45,7 +58,7 @@ namespace Tmdet::Engine {
                 }
             );
             protein.clear();
-            auto organizer = Tmdet::Engine::Organizer(protein, args);
+            auto organizer = Tmdet::Engine::Organizer(protein, args, (contacts.built?&contacts:nullptr));
             auto d = _fragmentData();
             d.id = i;
             d.clusterId = i;
@@ -134,7 +147,7 @@ namespace Tmdet::Engine {
                 }
             }
         );
-        auto organizer = Tmdet::Engine::Organizer(protein, args);
+        auto organizer = Tmdet::Engine::Organizer(protein, args, (contacts.built?&contacts:nullptr));
     }
 
     void Fragmenter::finalize() {
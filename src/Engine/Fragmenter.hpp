@@ -10,6 +10,7 @@
 
 #include <gemmi/math.hpp>
 #include <System/Arguments.hpp>
+#include <Utils/Surface.hpp>
 #include <VOs/Membrane.hpp>
 #include <VOs/Protein.hpp>
 #include <VOs/Region.hpp>
@@ -99,6 +100,17 @@ namespace Tmdet::Engine {
              */
             std::vector<gemmi::Vec3> depo;
 
+            /**
+             * @brief surface contacts of all fragments, the surface of the
+             *        fragments are derived from it
+             */
+            Tmdet::Utils::surfaceContacts contacts;
+
+            /**
+             * @brief calculate surface contacts of all fragments together
+             */
+            void setSurfaceContacts();
+
             /**
              * @brief run tmdet algorithm on fragments
              * 
@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <numeric>
 #include <any>
+#include <thread>
+#include <chrono>
 #include <gemmi/model.hpp>
 #include <gemmi/neighbor.hpp>
 #include <Config.hpp>
@@ -42,16 +44,19 @@ namespace Tmdet::Engine {
         boostAngle = args.getValueAsFloat("ba");
         boostBetaAngle = args.getValueAsFloat("bba");
         boostPolarity = args.getValueAsFloat("bp");
-        int numRes = 0;
-        protein.eachSelectedResidue(
-            [&](Tmdet::VOs::Residue& residue) -> void {
-                residue.temp.try_emplace("dist",std::any(0.0));
-                for(auto& atom: residue.atoms) {
-                    atom.temp.try_emplace("dist",std::any(0.0));
-                }
-                numRes++;
-            }
-        );
+        checkSmoothing = args.getValueAsBool("csq");
+        //pruned directions have no score, so searches ranking the directions
+        //(local refinement, hierarchical search) have to calculate all of them
+        pruning = !args.getValueAsBool("np") && !args.getValueAsBool("lr");
+        numRefinementSeeds = args.getValueAsInt("lrs");
+        normalBlock = std::stoi(environment.get("TMDET_NORMAL_BLOCK",DEFAULT_TMDET_NORMAL_BLOCK));
+        normalBlock = (normalBlock<1?1:normalBlock);
+        numThreads = args.getValueAsInt("t");
+        if (numThreads < 1) {
+            numThreads = (int)std::thread::hardware_concurrency();
+        }
+        int numRes = protein.numberOfSelectedResidues();
+        residueDistances.assign(numRes,0.0);
         addStraigth = args.getValueAsFloat("spen");
         addStraigth +=  (numRes>500?0.5:0) ;
         addStraigth +=  (numRes>1000?0.5:0) ;
@@ -73,55 +78,106 @@ namespace Tmdet::Engine {
                 }
             }
         );
+        setResidueAggregates();
+        setResidueCoordinates();
     }
 
-    void Optimizer::end() {
+    void Optimizer::setResidueCoordinates() {
+        residueCoords.x.clear();
+        residueCoords.y.clear();
+        residueCoords.z.clear();
+        emptyResidues.clear();
+        unsigned long int i = 0;
         protein.eachSelectedResidue(
-            [](Tmdet::VOs::Residue& residue) -> void {
-                residue.temp.erase("dist");
-                for(auto& atom: residue.atoms) {
-                    atom.temp.erase("dist");
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                gemmi::Vec3 pos;
+                if (residue.atoms.empty()) {
+                    emptyResidues.push_back(i);
+                }
+                else {
+                    pos = residue.atoms.back().gemmi.pos;
+                    for(auto& atom: residue.atoms) {
+                        if (atom.gemmi.name == "CA") {
+                            pos = atom.gemmi.pos;
+                        }
+                    }
                 }
+                residueCoords.x.push_back(pos.x);
+                residueCoords.y.push_back(pos.y);
+                residueCoords.z.push_back(pos.z);
+                i++;
             }
         );
+        //coordinates of the block evaluation do not depend on the normals
+        long int n = residueCoords.x.size();
+        blockCoords.resize(n,3);
+        using vector = Eigen::Matrix<Tmdet::real,Eigen::Dynamic,1>;
+        blockCoords.col(0) = Eigen::Map<const vector>(residueCoords.x.data(),n).array() - (Tmdet::real)massCentre.x;
+        blockCoords.col(1) = Eigen::Map<const vector>(residueCoords.y.data(),n).array() - (Tmdet::real)massCentre.y;
+        blockCoords.col(2) = Eigen::Map<const vector>(residueCoords.z.data(),n).array() - (Tmdet::real)massCentre.z;
+        blockSqNorms = blockCoords.rowwise().squaredNorm();
     }
 
-    void Optimizer::clear() {
-        bestQ = 0;
-    }
-
-    void Optimizer::setDistances() {
+    void Optimizer::setResidueAggregates() {
+        residueSurf.clear();
+        residueApol.clear();
         protein.eachSelectedResidue(
             [&](Tmdet::VOs::Residue& residue) -> void {
-                bool hasCA = false;
-                double d = 0.0;
-                gemmi::Vec3 ca;
-                for(auto& atom: residue.atoms) {
-                    d = distance(atom.gemmi.pos);
-                    atom.temp.at("dist") = std::any(d);
-                    ca = atom.gemmi.pos;
-                    if (atom.gemmi.name == "CA") {
-                        residue.temp.at("dist") = std::any(d);
-                        hasCA = true;
-                    }
+                double surf = 0.0;
+                double apol = 0.0;
+                if (protein.chains[residue.chainIdx].type == Tmdet::Types::ChainType::LOW_RES) {
+                    surf = 10;
+                    apol = 10 * residue.apol;
                 }
-                if (!hasCA) {
-                    residue.temp.at("dist") = std::any(d);
+                else {
+                    for(const auto& atom: residue.atoms) {
+                        surf += atom.outSurface;
+                        if (residue.type.atoms.contains(atom.gemmi.name)) {
+                            apol += atom.outSurface * (residue.ss.isBeta()?1.1:1.0) * ( 1-
+                                    (residue.type.atoms.at(atom.gemmi.name).mean - Tmdet::Types::voronotaMeanMin) / 
+                                        (Tmdet::Types::voronotaMeanMax - Tmdet::Types::voronotaMeanMin));
+                        }
+                    }
                 }
+                residueSurf.push_back(surf);
+                residueApol.push_back(apol);
             }
         );
     }
 
+    void Optimizer::end() {
+        residueDistances.clear();
+        residueSurf.clear();
+        residueApol.clear();
+        residueCoords.x.clear();
+        residueCoords.y.clear();
+        residueCoords.z.clear();
+        emptyResidues.clear();
+        workers.clear();
+        blockCoords.resize(0,3);
+        blockProjections.resize(0,0);
+        blockSqNorms.resize(0);
+        candidates.clear();
+    }
+
+    void Optimizer::clear() {
+        bestQ = 0;
+    }
+
+    void Optimizer::setDistances() {
+        projectResidues();
+        for (auto i: emptyResidues) {
+            residueDistances[i] = 0.0;
+        }
+    }
+
     void Optimizer::setBoundaries() {
         minZ = 1e30;
         maxZ = -1e30;
-        protein.eachSelectedResidue(
-            [&](Tmdet::VOs::Residue& residue) -> void {
-                auto dist = any_cast<double>(residue.temp.at("dist"));
-                minZ = (dist < minZ ? dist : minZ);
-                maxZ = (dist > maxZ ? dist : maxZ);
-            }
-        );
+        for(auto dist: residueDistances) {
+            minZ = (dist < minZ ? dist : minZ);
+            maxZ = (dist > maxZ ? dist : maxZ);
+        }
         minZ-=1; maxZ+=1;
         slices.clear();
         slices.resize((unsigned int)(maxZ-minZ));
@@ -130,25 +186,19 @@ namespace Tmdet::Engine {
 
 
     void Optimizer::sumupSlices() {
-        protein.eachSelectedResidue(
-            [&](Tmdet::VOs::Residue& residue) -> void {
-                auto sliceIndex = (unsigned int)(any_cast<double>(residue.temp.at("dist")) - minZ);
-                if (protein.chains[residue.chainIdx].type == Tmdet::Types::ChainType::LOW_RES) {
-                    slices[sliceIndex].surf+=10;
-                    slices[sliceIndex].apol += 10 * residue.apol;
-                }
-                else {
-                    for(const auto& atom: residue.atoms) {
-                        slices[sliceIndex].surf += atom.outSurface;
-                        if (residue.type.atoms.contains(atom.gemmi.name)) {
-                            slices[sliceIndex].apol += atom.outSurface * (residue.ss.isBeta()?1.1:1.0) * ( 1-
-                                    (residue.type.atoms.at(atom.gemmi.name).mean - Tmdet::Types::voronotaMeanMin) / 
-                                        (Tmdet::Types::voronotaMeanMax - Tmdet::Types::voronotaMeanMin));
-                        }
-                    }
-                }
-            }
-        );
+        sumupResidues();
+        sumupSecStrVecs();
+    }
+
+    void Optimizer::sumupResidues() {
+        for (unsigned long int i=0; i<residueDistances.size(); i++) {
+            auto sliceIndex = (unsigned int)(residueDistances[i] - minZ);
+            slices[sliceIndex].surf += residueSurf[i];
+            slices[sliceIndex].apol += residueApol[i];
+        }
+    }
+
+    void Optimizer::sumupSecStrVecs() {
         for (auto& vector: protein.secStrVecs) {
             if (protein.chains[vector.chainIdx].selected
                 && protein.chains[vector.chainIdx].residues[vector.begResIdx].selected
@@ -177,7 +227,7 @@ namespace Tmdet::Engine {
                     && protein.chains[vector.chainIdx].residues[vector.endResIdx].selected)  {
                     for (int j=vector.begResIdx; j<=vector.endResIdx; j++) {
                         if (protein.chains[vector.chainIdx].residues[j].selected) {
-                            int i = distance(any_cast<gemmi::Vec3&>(protein.chains[vector.chainIdx].residues[j].temp["ca"])) - minZ;
+                            int i = distance(any_cast<gemmi::Vec3&>(protein.chains[vector.chainIdx].residues[j].temp.at("ca"))) - minZ;
                             if (i>=0 && i<(int)slices.size()) {
                                 
                                 if (vector.type.isBeta()) {
@@ -211,16 +261,83 @@ namespace Tmdet::Engine {
         }
     }
 
-    double Optimizer::divide(double numerator, double denominator) {
+    double Optimizer::divide(double numerator, double denominator) const {
         double q= ( denominator<1e-5?0.0:numerator/denominator);
         return (q>1?1.0:q);
     }
 
     void Optimizer::smoothQValues() {
-        std::string n="***************************************************************************";
-        std::string m="mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm";
-        std::string b="bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb";
+        long int s = slices.size();
+        auto& p = profile;
+        p.straight.resize(s+1);
+        p.apol.resize(s+1);
+        p.ssEnd.resize(s+1);
+        p.surf.resize(s+1);
+        p.numCa.resize(s+1);
+        p.rawQ.resize(s+1);
+        p.box.resize(s+9);
+        p.straight[0] = p.apol[0] = p.ssEnd[0] = p.surf[0] = p.numCa[0] = p.rawQ[0] = p.box[0] = 0.0;
+        for(long int i = 0; i<s; i++) {
+            p.straight[i+1] = p.straight[i] + (slices[i].beta>7?slices[i].beta:slices[i].alpha);
+            p.apol[i+1] = p.apol[i] + slices[i].apol;
+            p.ssEnd[i+1] = p.ssEnd[i] + slices[i].ssEnd;
+            p.surf[i+1] = p.surf[i] + slices[i].surf;
+            p.numCa[i+1] = p.numCa[i] + slices[i].numCa;
+        }
+
+        //+-2 box window
+        for(long int i = 0; i<s; i++) {
+            long int lo = (i-2<0?0:i-2);
+            long int hi = (i+2>=s?s-1:i+2) + 1;
+            double k = hi - lo;
+            double smoothedStraight = (p.straight[hi] - p.straight[lo]) / k;
+            double smoothedApol = (p.apol[hi] - p.apol[lo]) / k;
+            double smoothedSsEnd = (p.ssEnd[hi] - p.ssEnd[lo]) / k;
+            double smoothedSurf = (p.surf[hi] - p.surf[lo]) / k;
+            double smoothedCa = (p.numCa[hi] - p.numCa[lo]) / k;
+            smoothedStraight = 1.2*divide(smoothedStraight,(smoothedCa + addStraigth));
+            smoothedStraight = (smoothedStraight<0?0:smoothedStraight);
+            smoothedApol = (smoothedSurf>5?divide(smoothedApol, smoothedSurf):0); 
+            smoothedApol = (smoothedApol>boostPolarity?1:smoothedApol);
+            smoothedSsEnd = divide(smoothedSsEnd, smoothedCa);
+            //smoothing of interfacial helices is switched off
+            slices[i].smoothedIfh = 0;
+            slices[i].rawQ = 100.0 * smoothedStraight * (1.0 - smoothedSsEnd) * smoothedApol;
+            p.rawQ[i+1] = p.rawQ[i] + slices[i].rawQ;
+        }
+
+        //triangular window (weights 9-|j|, j=-8..8) as two +-4 box passes,
+        //the first pass is calculated for the 4 slices beyond both ends, too
+        for(long int m = -4; m<s+4; m++) {
+            long int lo = (m-4<0?0:m-4);
+            long int hi = (m+4>=s?s-1:m+4) + 1;
+            p.box[m+5] = p.box[m+4] + (hi>lo?p.rawQ[hi]-p.rawQ[lo]:0.0);
+        }
+        for(long int i = 0; i<s; i++) {
+            int k = 0;
+            for (int j=-8; j<=8; j++) {
+                if (j+i>=0 && j+i<s) {
+                    k += 9 - std::abs(j);
+                }
+            }
+            double q = (p.box[i+9] - p.box[i]) / k;
+            slices[i].qValue = q;
+            maxSliceQ = (q>maxSliceQ?q:maxSliceQ);
+        }
+
+        if (checkSmoothing) {
+            auto qValues = smoothQValuesReference();
+            for(long int i = 0; i<s; i++) {
+                double e = std::abs(qValues[i] - slices[i].qValue);
+                maxSmoothingError = (e>maxSmoothingError?e:maxSmoothingError);
+            }
+        }
+    }
+
+    std::vector<double> Optimizer::smoothQValuesReference() const {
         auto s = slices.size();
+        std::vector<double> rawQ(s);
+        std::vector<double> qValues(s);
         for(unsigned long int i = 0; i<s; i++) {
             int k=0;
             double smoothedStraight = 0.0;
@@ -252,9 +369,7 @@ namespace Tmdet::Engine {
             smoothedApol = (smoothedApol>boostPolarity?1:smoothedApol);
             smoothedSsEnd = divide(smoothedSsEnd, smoothedCa);
             smoothedIfh = 0;
-            slices[i].smoothedIfh = smoothedIfh;
-
-            slices[i].rawQ = 100.0 * smoothedStraight * (1.0 - smoothedSsEnd) * (1.0 - smoothedIfh) * smoothedApol;
+            rawQ[i] = 100.0 * smoothedStraight * (1.0 - smoothedSsEnd) * (1.0 - smoothedIfh) * smoothedApol;
         }
         for(unsigned long int i = 0; i<s; i++) {
             int k=0;
@@ -262,17 +377,27 @@ namespace Tmdet::Engine {
             for (int j=-8; j<=8; j++) {
                 if (j+(int)i>=0 && j+i<s) {
                     int w = (9 - std::abs(j));
-                    q += w * slices[j+i].rawQ;
+                    q += w * rawQ[j+i];
                     k += w;
                 }
             }
-            q/=k;
-            slices[i].qValue = q;
+            qValues[i] = q/k;
+        }
+        return qValues;
+    }
+
+    void Optimizer::reportSmoothingCheck() const {
+        if (maxSmoothingError > 1e-9) {
+            logger.warn("Smoothed qValues differ from the reference ones, maximal difference: {}",maxSmoothingError);
+        }
+        else {
+            logger.info("Smoothed qValues match the reference ones, maximal difference: {}",maxSmoothingError);
         }
     }
 
     void Optimizer::checkBestSlice() {
         auto s = slices.size();
+        bool improved = false;
 
         if ((int)s > 2 * minHalfThickness) {
             for(int i = minHalfThickness/2; i < (int)s - minHalfThickness/2; i++) {
@@ -280,19 +405,34 @@ namespace Tmdet::Engine {
                 int maxz;
                 if (slices[i].qValue>higherQ) {
                     double q = getWidth(i,minz,maxz);
-                    if (maxz-minz > 2 * minHalfThickness 
-                        && ((q>bestQ && minz>5 && maxz<(int)s-5)
-                            || q>bestQ + 6)) {
-                        bestQ = q;
-                        bestMinZ = minz; bestMinZ -= 0.5;
-                        bestMaxZ = maxz; bestMaxZ -= 0.5;
-                        bestNormal = normal;
-                        bestSlices = slices;
-                        setBestOrigo(minz,maxz);
+                    if (maxz-minz > 2 * minHalfThickness) {
+                        _candidate candidate = {q, (minz>5 && maxz<(int)s-5), minz, maxz, minZ, getOrigo(), normal};
+                        if (collectCandidates) {
+                            candidates.push_back(candidate);
+                        }
+                        else if (acceptCandidate(candidate)) {
+                            improved = true;
+                        }
                     }
                 }
             }
         }
+        if (improved && keepBestSlices) {
+            //slices are rebuilt for the next normal, so the buffers can be swapped
+            std::swap(slices,bestSlices);
+        }
+    }
+
+    bool Optimizer::acceptCandidate(const _candidate& candidate) {
+        if ((candidate.q>bestQ && candidate.inside) || candidate.q>bestQ + 6) {
+            bestQ = candidate.q;
+            bestMinZ = candidate.minz; bestMinZ -= 0.5;
+            bestMaxZ = candidate.maxz; bestMaxZ -= 0.5;
+            bestNormal = candidate.normal;
+            setBestOrigo(candidate.minz,candidate.maxz);
+            return true;
+        }
+        return false;
     }
 
     double Optimizer::getWidth(const int z, int& minz, int& maxz) {
@@ -351,24 +491,340 @@ namespace Tmdet::Engine {
 
     void Optimizer::testMembraneNormalOne() {
         setDistances();
+        testMembraneNormalDistances();
+    }
+
+    void Optimizer::testMembraneNormalDistances() {
         setBoundaries();
-        sumupSlices();
+        sumupResidues();
+        numEvaluations++;
+        if (pruning) {
+            //a candidate must have higher qValue than both higherQ and bestQ
+            double bound = qValueUpperBound();
+            if (bound + 1e-6 < std::max(higherQ,bestQ)) {
+                numPruned++;
+                return;
+            }
+        }
+        sumupSecStrVecs();
         smoothQValues();
         checkBestSlice();
     }
 
+    double Optimizer::qValueUpperBound() {
+        long int s = slices.size();
+        if (s <= 2 * minHalfThickness) {
+            return 0.0;
+        }
+        auto& p = profile;
+        p.apol.resize(s+1);
+        p.surf.resize(s+1);
+        p.apol[0] = p.surf[0] = 0.0;
+        for(long int i = 0; i<s; i++) {
+            p.apol[i+1] = p.apol[i] + slices[i].apol;
+            p.surf[i+1] = p.surf[i] + slices[i].surf;
+        }
+        //rawQ = 100 * straight * (1 - ssEnd) * apol, where straight <= 1.2,
+        //and qValue is a weighted average of rawQ values
+        double bound = 0.0;
+        for(long int i = 0; i<s; i++) {
+            long int lo = (i-2<0?0:i-2);
+            long int hi = (i+2>=s?s-1:i+2) + 1;
+            double k = hi - lo;
+            double smoothedApol = (p.apol[hi] - p.apol[lo]) / k;
+            double smoothedSurf = (p.surf[hi] - p.surf[lo]) / k;
+            smoothedApol = (smoothedSurf>5?divide(smoothedApol, smoothedSurf):0);
+            smoothedApol = (smoothedApol>boostPolarity?1:smoothedApol);
+            bound = std::max(bound,120.0 * smoothedApol);
+        }
+        return bound;
+    }
+
     void Optimizer::setNormal(gemmi::Vec3 _normal) {
         normal = _normal;
     }
 
     void Optimizer::searchForMembraneNormal() {
+        createWorkers();
+        if (args.getValueAsBool("hsb")) {
+            benchmarkHierarchicalSearch();
+        }
+        else if (args.getValueAsBool("hs")) {
+            searchForMembraneNormalHierarchical();
+        }
+        else {
+            searchForMembraneNormalExhaustive();
+        }
+        workers.clear();
+        if (checkSmoothing) {
+            reportSmoothingCheck();
+        }
+        INFO_LOG("{} optimizer: {} normals tested, {} of {} qValue calculations pruned",
+            type,numTestedNormals,numPruned,numEvaluations);
+    }
+
+    void Optimizer::searchForMembraneNormalExhaustive() {
         Tmdet::Engine::Rotator rotator;
         if (type == "Curved") {
             rotator.end180();
         }
-        while(rotator.next(normal)) {
-            testMembraneNormal();
+        std::vector<gemmi::Vec3> normals;
+        gemmi::Vec3 vec;
+        while(rotator.next(vec)) {
+            normals.push_back(vec);
+        }
+        auto scores = testMembraneNormals(normals);
+        setBestDirections(normals,scores);
+    }
+
+    void Optimizer::setBestDirections(const std::vector<gemmi::Vec3>& normals, const std::vector<double>& scores) {
+        std::vector<unsigned long int> order(normals.size());
+        std::iota(order.begin(),order.end(),0);
+        std::stable_sort(order.begin(),order.end(),
+            [&](unsigned long int a, unsigned long int b) -> bool {
+                return scores[a] > scores[b];
+            }
+        );
+        bestDirections.clear();
+        for (unsigned long int i=0; i<order.size() && (int)i<numRefinementSeeds; i++) {
+            bestDirections.push_back(normals[order[i]]);
+        }
+    }
+
+    unsigned long int Optimizer::refineMembraneNormal(const std::vector<gemmi::Vec3>& axes) {
+        bool fullSphere = (type == "Curved");
+        unsigned long int budget = std::max(args.getValueAsInt("lrb"),0);
+        double resolution = std::max((double)args.getValueAsFloat("lrr"),1e-3);
+        std::vector<gemmi::Vec3> seeds = bestDirections;
+        for (const auto& axis: axes) {
+            seeds.push_back(axis);
+            if (fullSphere) {
+                seeds.push_back(-1.0 * axis);
+            }
+        }
+        if (seeds.size() > budget) {
+            //best directions come first, then the symmetry axes
+            logger.warn("Local refinement: {} seeds exceed the budget of {} normals, only the first {} are refined",
+                seeds.size(),budget,budget);
+            seeds.resize(budget);
+        }
+        if (seeds.empty()) {
+            return 0;
+        }
+        createWorkers();
+        auto seedScores = testMembraneNormals(seeds);
+        unsigned long int tested = seeds.size();
+
+        //pattern search: move to the best neighbour if it is better,
+        //otherwise halve the step, until the resolution or the budget is reached
+        double initialStep = std::stof(environment.get("TMDET_BALL_DIST",DEFAULT_TMDET_BALL_DIST)) / 2;
+        std::vector<double> steps(seeds.size(),initialStep);
+        while (true) {
+            std::vector<gemmi::Vec3> normals;
+            std::vector<unsigned long int> owners;
+            for (unsigned long int k=0; k<seeds.size(); k++) {
+                if (steps[k] >= resolution) {
+                    auto neighbours = Tmdet::Engine::Rotator::neighbours(seeds[k],steps[k],fullSphere);
+                    normals.insert(normals.end(),neighbours.begin(),neighbours.end());
+                    owners.insert(owners.end(),neighbours.size(),k);
+                }
+            }
+            if (normals.empty() || tested + normals.size() > budget) {
+                break;
+            }
+            auto scores = testMembraneNormals(normals);
+            tested += normals.size();
+            std::vector<bool> moved(seeds.size(),false);
+            for (unsigned long int j=0; j<normals.size(); j++) {
+                if (unsigned long int k = owners[j]; scores[j] > seedScores[k]) {
+                    seedScores[k] = scores[j];
+                    seeds[k] = normals[j];
+                    moved[k] = true;
+                }
+            }
+            for (unsigned long int k=0; k<seeds.size(); k++) {
+                if (!moved[k]) {
+                    steps[k] /= 2;
+                }
+            }
+        }
+        workers.clear();
+        return tested;
+    }
+
+    void Optimizer::searchForMembraneNormalHierarchical() {
+        bool fullSphere = (type == "Curved");
+        int numCoarse = std::max(args.getValueAsInt("hsn"),1);
+        int topK = std::max(args.getValueAsInt("hsk"),1);
+        double resolution = std::max((double)args.getValueAsFloat("hsr"),1e-3);
+        bool prune = pruning;
+        pruning = false;
+
+        //coarse search
+        auto directions = Tmdet::Engine::Rotator::fibonacciLattice(numCoarse,fullSphere);
+        auto scores = testMembraneNormals(directions);
+        std::vector<unsigned long int> order(directions.size());
+        std::iota(order.begin(),order.end(),0);
+        std::stable_sort(order.begin(),order.end(),
+            [&](unsigned long int a, unsigned long int b) -> bool {
+                return scores[a] > scores[b];
+            }
+        );
+        std::vector<gemmi::Vec3> seeds;
+        std::vector<double> seedScores;
+        for (unsigned long int i=0; i<order.size() && (int)i<topK; i++) {
+            seeds.push_back(directions[order[i]]);
+            seedScores.push_back(scores[order[i]]);
+        }
+
+        //refinement around the best directions, halving the angular step
+        //until it reaches the requested resolution (the last step is clamped to it)
+        double step = std::max(sqrt((fullSphere?4.0:2.0) * M_PI / numCoarse) / 2, resolution);
+        while (true) {
+            std::vector<gemmi::Vec3> normals;
+            std::vector<unsigned long int> owners;
+            for (unsigned long int k=0; k<seeds.size(); k++) {
+                auto neighbours = Tmdet::Engine::Rotator::neighbours(seeds[k],step,fullSphere);
+                normals.insert(normals.end(),neighbours.begin(),neighbours.end());
+                owners.insert(owners.end(),neighbours.size(),k);
+            }
+            scores = testMembraneNormals(normals);
+            for (unsigned long int j=0; j<normals.size(); j++) {
+                if (unsigned long int k = owners[j]; scores[j] > seedScores[k]) {
+                    seedScores[k] = scores[j];
+                    seeds[k] = normals[j];
+                }
+            }
+            if (step <= resolution) {
+                break;
+            }
+            step = std::max(step / 2, resolution);
+        }
+        setBestDirections(seeds,seedScores);
+        pruning = prune;
+    }
+
+    void Optimizer::benchmarkHierarchicalSearch() {
+        numTestedNormals = 0;
+        auto start = std::chrono::steady_clock::now();
+        searchForMembraneNormalHierarchical();
+        std::chrono::duration<double> hsTime = std::chrono::steady_clock::now() - start;
+        unsigned long int hsTested = numTestedNormals;
+        double hsQ = bestQ;
+        gemmi::Vec3 hsNormal = bestNormal;
+
+        //the exhaustive search is the reference, its result is kept
+        clear();
+        numTestedNormals = 0;
+        start = std::chrono::steady_clock::now();
+        searchForMembraneNormalExhaustive();
+        std::chrono::duration<double> exTime = std::chrono::steady_clock::now() - start;
+
+        double cosAngle = Tmdet::Helpers::Vector::cosAngle(hsNormal,bestNormal);
+        if (type != "Curved") {
+            cosAngle = std::abs(cosAngle);
+        }
+        cosAngle = (cosAngle>1?1:cosAngle);
+        double angle = acos(cosAngle) * 180.0 / M_PI;
+        //same membrane: same TM call and, for transmembrane proteins,
+        //nearly parallel normals with nearly equal qValues
+        bool sameCall = (isTransmembrane() == (hsQ > higherQ));
+        bool sameMembrane = sameCall && (!isTransmembrane() || (angle <= 5.0 && std::abs(hsQ - bestQ) <= 1.0));
+        logger.info("Hierarchical search benchmark ({} optimizer, {} thread(s))",type,numThreads);
+        logger.info("  exhaustive:   {} normals, {} s, qValue: {}",numTestedNormals,exTime.count(),bestQ);
+        logger.info("  hierarchical: {} normals, {} s, qValue: {}",hsTested,hsTime.count(),hsQ);
+        logger.info("  speedup: {}, angle between normals: {} degree, qValue difference: {}, same TM call: {}, same membrane: {}",
+            (hsTime.count()>0?exTime.count()/hsTime.count():0.0),angle,hsQ - bestQ,
+            (sameCall?"yes":"no"),(sameMembrane?"yes":"no"));
+    }
+
+    std::vector<double> Optimizer::testMembraneNormals(const std::vector<gemmi::Vec3>& normals) {
+        std::vector<double> scores(normals.size(),0.0);
+        numTestedNormals += normals.size();
+        if (numThreads > 1) {
+            testMembraneNormalsInParallel(normals,scores);
+        }
+        else {
+            for (unsigned long int beg=0; beg<normals.size(); beg+=normalBlock) {
+                testMembraneNormalBlock(normals,beg,std::min(beg+normalBlock,normals.size()),scores);
+            }
+        }
+        return scores;
+    }
+
+    void Optimizer::testMembraneNormalBlock(const std::vector<gemmi::Vec3>& normals, unsigned long int beg,
+        unsigned long int end, std::vector<double>& scores) {
+        Eigen::Matrix<Tmdet::real,3,Eigen::Dynamic> directions(3,end-beg);
+        for (unsigned long int k=beg; k<end; k++) {
+            directions.col(k-beg) << (Tmdet::real)normals[k].x, (Tmdet::real)normals[k].y, (Tmdet::real)normals[k].z;
+        }
+        blockProjections.noalias() = blockCoords * directions;
+        startBlock();
+        for (unsigned long int k=beg; k<end; k++) {
+            normal = normals[k];
+            maxSliceQ = -1.0;
+            testMembraneNormalProjected(blockProjections.col(k-beg).data());
+            scores[k] = maxSliceQ;
+        }
+    }
+
+    void Optimizer::testMembraneNormalsInParallel(const std::vector<gemmi::Vec3>& normals, std::vector<double>& scores) {
+        unsigned long int n = std::min((unsigned long int)numThreads, (unsigned long int)normals.size());
+        if (n == 0) {
+            return;
+        }
+        unsigned long int chunk = (normals.size() + n - 1) / n;
+        //chunks are made of whole blocks, so the blocks are the same as in the serial search
+        chunk = (chunk + normalBlock - 1) / normalBlock * normalBlock;
+        if (workers.size() < n) {
+            createWorkers();
+        }
+        //workers are reused between the rounds of a search, only the state
+        //of the main optimizer they depend on is copied
+        for (unsigned long int t=0; t<n; t++) {
+            workers[t]->numEvaluations = 0;
+            workers[t]->numPruned = 0;
+            workers[t]->candidates.clear();
+            workers[t]->bestQ = bestQ;
+            workers[t]->pruning = pruning;
+        }
+        std::vector<std::thread> threads;
+        for (unsigned long int t=0; t<n; t++) {
+            threads.emplace_back(
+                [&normals, &scores, worker = workers[t].get(), beg = t * chunk, end = std::min((t + 1) * chunk, normals.size())]() -> void {
+                    for (unsigned long int i=beg; i<end; i+=worker->normalBlock) {
+                        worker->testMembraneNormalBlock(normals,i,std::min(i+worker->normalBlock,end),scores);
+                    }
+                }
+            );
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        //replay candidates in the order of the normals as the serial search does
+        for (unsigned long int t=0; t<n; t++) {
+            const auto& worker = workers[t];
+            maxSmoothingError = std::max(maxSmoothingError,worker->maxSmoothingError);
+            numEvaluations += worker->numEvaluations;
+            numPruned += worker->numPruned;
+            for (const auto& candidate: worker->candidates) {
+                normal = candidate.normal;
+                minZ = candidate.minZ;
+                setOrigo(candidate.origo);
+                acceptCandidate(candidate);
+            }
+        }
+    }
+
+    void Optimizer::createWorkers() {
+        workers.clear();
+        //workers are cloned before any of them is stored, so they have no workers
+        std::vector<std::shared_ptr<Optimizer>> created;
+        for (int t=0; t<numThreads && numThreads>1; t++) {
+            created.emplace_back(clone());
+            created[t]->collectCandidates = true;
         }
+        workers = std::move(created);
     }
 
     bool Optimizer::isTransmembrane() const {
@@ -383,7 +839,9 @@ namespace Tmdet::Engine {
         }
         normal = bestNormal;
         bestQ = 0;
+        keepBestSlices = true;
         testMembraneNormalFinal();
+        keepBestSlices = false;
         Tmdet::VOs::Membrane membrane;
         protein.membranes.clear();
         int i=0;
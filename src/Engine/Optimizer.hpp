@@ -8,7 +8,10 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <eigen3/Eigen/Dense>
 #include <gemmi/model.hpp>
+#include <Config.hpp>
 #include <System/Arguments.hpp>
 #include <VOs/Protein.hpp>
 #include <VOs/Residue.hpp>
@@ -26,6 +29,71 @@ namespace Tmdet::Engine {
 
 #define RES(res,a) (protein.chains[res.chainIdx].residues[res.idx + a])
 
+    /**
+     * @brief membrane definition candidate found for a membrane normal,
+     *        collected by the worker threads of the parallel search
+     */
+    struct _candidate {
+        /**
+         * @brief qValue of the candidate
+         */
+        double q;
+
+        /**
+         * @brief flag if the candidate is not at the edge of the protein
+         */
+        bool inside;
+
+        /**
+         * @brief first and last slice of the membrane
+         */
+        int minz;
+        int maxz;
+
+        /**
+         * @brief minimum on z axes for the normal vector of the candidate
+         */
+        double minZ;
+
+        /**
+         * @brief origo (centre of the sphere in case of curved membrane)
+         */
+        double origo;
+
+        /**
+         * @brief membrane normal of the candidate
+         */
+        gemmi::Vec3 normal;
+    };
+
+    /**
+     * @brief structure of arrays of the representative atom coordinates
+     *        (CA or the last atom) of the selected residues
+     */
+    struct _coordinates {
+        std::vector<Tmdet::real> x;
+        std::vector<Tmdet::real> y;
+        std::vector<Tmdet::real> z;
+    };
+
+    /**
+     * @brief reusable workspace of smoothing slice profiles, it contains
+     *        the prefix sums of slice properties (one array for each)
+     */
+    struct _sliceProfile {
+        std::vector<double> straight;
+        std::vector<double> apol;
+        std::vector<double> ssEnd;
+        std::vector<double> surf;
+        std::vector<double> numCa;
+        std::vector<double> rawQ;
+
+        /**
+         * @brief prefix sums of the first box pass of triangular smoothing
+         */
+        std::vector<double> box;
+    };
+
     /**
      * @brief class for searching for membrane plane
      */
@@ -47,11 +115,142 @@ namespace Tmdet::Engine {
              */
             std::string type = "";
 
+            /**
+             * @brief number of threads used in membrane normal search
+             */
+            int numThreads = 1;
+
+            /**
+             * @brief optimizers of the worker threads, they are created once
+             *        for a search (shared_ptr keeps the optimizer copyable for clone)
+             */
+            std::vector<std::shared_ptr<Optimizer>> workers;
+
+            /**
+             * @brief flag for collecting candidates instead of setting the best one
+             *        (used by the worker threads)
+             */
+            bool collectCandidates = false;
+
+            /**
+             * @brief candidates collected by a worker thread
+             */
+            std::vector<_candidate> candidates;
+
+            /**
+             * @brief maximal qValue of slices since the last reset, it is used
+             *        for ranking directions in the hierarchical search
+             *        (-1 if all qValue calculations of the direction were pruned)
+             */
+            double maxSliceQ = 0.0;
+
+            /**
+             * @brief number of membrane normals tested by the search
+             */
+            unsigned long int numTestedNormals = 0;
+
+            /**
+             * @brief best directions of the search, seeds of the local refinement
+             */
+            std::vector<gemmi::Vec3> bestDirections;
+
+            /**
+             * @brief number of best directions kept for local refinement
+             */
+            int numRefinementSeeds = 3;
+
+            /**
+             * @brief flag for skipping normals (and origos) those can not
+             *        result better membrane than the actual best one
+             */
+            bool pruning = true;
+
+            /**
+             * @brief number of qValue calculations (one for each normal and origo)
+             */
+            unsigned long int numEvaluations = 0;
+
+            /**
+             * @brief number of qValue calculations skipped by the upper bound
+             */
+            unsigned long int numPruned = 0;
+
+            /**
+             * @brief distances of the selected residues from the membrane plane
+             *        or the centre of the sphere
+             */
+            std::vector<Tmdet::real> residueDistances;
+
+            /**
+             * @brief snapshot of the representative coordinates of the
+             *        selected residues, made once in init
+             */
+            _coordinates residueCoords;
+
+            /**
+             * @brief number of membrane normals evaluated together in one block
+             */
+            int normalBlock = 16;
+
+            /**
+             * @brief residue coordinates relative to the mass centre
+             *        (used by the block evaluation)
+             */
+            Eigen::Matrix<Tmdet::real,Eigen::Dynamic,3> blockCoords;
+
+            /**
+             * @brief projections of the residue coordinates onto a block of
+             *        membrane normals (one column for each normal)
+             */
+            Eigen::Matrix<Tmdet::real,Eigen::Dynamic,Eigen::Dynamic> blockProjections;
+
+            /**
+             * @brief squared distances of the residue coordinates from the
+             *        mass centre (used by the curved optimizer)
+             */
+            Eigen::Matrix<Tmdet::real,Eigen::Dynamic,1> blockSqNorms;
+
+            /**
+             * @brief indexes of selected residues without any atom
+             *        (their distance is always 0)
+             */
+            std::vector<unsigned long int> emptyResidues;
+
+            /**
+             * @brief outside surface of the selected residues (it does not
+             *        depend on the membrane normal, so calculated only once)
+             */
+            std::vector<Tmdet::real> residueSurf;
+
+            /**
+             * @brief apolar outside surface of the selected residues (it does
+             *        not depend on the membrane normal, so calculated only once)
+             */
+            std::vector<Tmdet::real> residueApol;
+
             /**
              * @brief 1 Angstrom wide slices of the protein along the z axes
              */
             std::vector<Tmdet::VOs::Slice> slices;
 
+            /**
+             * @brief workspace for smoothing qValues (each worker thread
+             *        has its own copy)
+             */
+            _sliceProfile profile;
+
+            /**
+             * @brief flag for checking smoothed qValues against the
+             *        reference (window based) implementation
+             */
+            bool checkSmoothing = false;
+
+            /**
+             * @brief maximal difference between the smoothed qValues and
+             *        the reference ones
+             */
+            double maxSmoothingError = 0.0;
+
             /**
              * @brief the actual membrane normal
              */
@@ -72,6 +271,13 @@ namespace Tmdet::Engine {
              */
             std::vector<Tmdet::VOs::Slice> bestSlices;
 
+            /**
+             * @brief flag for keeping the slices of the best membrane definition,
+             *        it is set only when the final profile is recalculated for
+             *        the best normal, the search itself keeps only the parameters
+             */
+            bool keepBestSlices = false;
+
             /**
              * @brief minimum on z axes for the given normal vector
              */
@@ -123,6 +329,19 @@ namespace Tmdet::Engine {
              */
             void end();
 
+            /**
+             * @brief calculate the surface and apolar surface of the
+             *        selected residues
+             */
+            void setResidueAggregates();
+
+            /**
+             * @brief make a snapshot of the representative coordinates
+             *        of the selected residues and their coordinates relative
+             *        to the mass centre for the block evaluation
+             */
+            void setResidueCoordinates();
+
             /**
              * @brief distance of the atom from the membrane plane
              *        or the centre of the sphere
@@ -132,11 +351,54 @@ namespace Tmdet::Engine {
              */
             virtual double distance(gemmi::Vec3& vec) = 0;
 
+            /**
+             * @brief calculate the distance of every residue coordinate
+             *        in residueCoords into residueDistances
+             */
+            virtual void projectResidues() = 0;
+
+            /**
+             * @brief calculate qValue for the actual membrane normal using the
+             *        projections of the residues calculated by block evaluation
+             * 
+             * @param projection projection of the residues (relative to the
+             *        mass centre) onto the actual membrane normal
+             */
+            virtual void testMembraneNormalProjected(const Tmdet::real* projection) = 0;
+
 
             virtual double getAngle(Tmdet::VOs::SecStrVec& vector) = 0;
 
             virtual void testMembraneNormalFinal() = 0;
 
+            /**
+             * @brief create a copy of the optimizer for a worker thread
+             * 
+             * @return std::unique_ptr<Optimizer> 
+             */
+            virtual std::unique_ptr<Optimizer> clone() const = 0;
+
+            /**
+             * @brief get the actual origo (centre of the sphere in case of curved membrane)
+             * 
+             * @return double 
+             */
+            virtual double getOrigo() const {
+                return 0.0;
+            }
+
+            /**
+             * @brief set the actual origo (centre of the sphere in case of curved membrane)
+             * 
+             * @param o 
+             */
+            virtual void setOrigo(double o) {}
+
+            /**
+             * @brief called before evaluating a block of membrane normals
+             */
+            virtual void startBlock() {}
+
             /**
              * @brief Set the distances from the centre of membrane plane
              */
@@ -152,6 +414,26 @@ namespace Tmdet::Engine {
              */
             void sumupSlices();
 
+            /**
+             * @brief sumup surface and apolar surface of residues in slices
+             *        (it does not need the secondary structure elements)
+             */
+            void sumupResidues();
+
+            /**
+             * @brief sumup secondary structure element properties in slices
+             */
+            void sumupSecStrVecs();
+
+            /**
+             * @brief upper bound of slice qValues for the actual normal, it is
+             *        calculated from the apolar surface of slices supposing
+             *        perfectly straight secondary structures without ends
+             * 
+             * @return double 
+             */
+            double qValueUpperBound();
+
             /**
              * @brief helper function to divide two numbers
              * 
@@ -159,18 +441,102 @@ namespace Tmdet::Engine {
              * @param denominator 
              * @return double 
              */
-            double divide(double numerator, double denominator);
+            double divide(double numerator, double denominator) const;
 
             /**
-             * @brief smooth Q values 
+             * @brief smooth Q values using prefix sums
              */
             void smoothQValues();
 
+            /**
+             * @brief smooth Q values by summing up the windows of each slice,
+             *        used for checking the result of smoothQValues
+             * 
+             * @return std::vector<double> qValues of slices
+             */
+            std::vector<double> smoothQValuesReference() const;
+
+            /**
+             * @brief report the result of the smoothing check
+             */
+            void reportSmoothingCheck() const;
+
             /**
              * @brief Get the best qValue that has the apropriate membrane width
              */
             void checkBestSlice();
 
+            /**
+             * @brief set the candidate as best membrane definition if its
+             *        qValue is better than the actual best one
+             * 
+             * @param candidate 
+             * @return bool
+             */
+            bool acceptCandidate(const _candidate& candidate);
+
+            /**
+             * @brief calculate qValue for the given membrane normals (serial or
+             *        parallel depending on the number of threads)
+             * 
+             * @param normals 
+             * @return std::vector<double> maximal slice qValue for each normal
+             */
+            std::vector<double> testMembraneNormals(const std::vector<gemmi::Vec3>& normals);
+
+            /**
+             * @brief calculate qValue for a block of membrane normals, residue
+             *        coordinates are projected onto all of them by one matrix product
+             * 
+             * @param normals 
+             * @param beg first normal of the block
+             * @param end end of the block
+             * @param scores maximal slice qValue for each normal
+             */
+            void testMembraneNormalBlock(const std::vector<gemmi::Vec3>& normals, unsigned long int beg,
+                unsigned long int end, std::vector<double>& scores);
+
+            /**
+             * @brief calculate qValue for the given membrane normals using
+             *        worker threads, the best one is selected in the order
+             *        of the normals, so the result is the same as the serial one
+             * 
+             * @param normals 
+             * @param scores maximal slice qValue for each normal
+             */
+            void testMembraneNormalsInParallel(const std::vector<gemmi::Vec3>& normals, std::vector<double>& scores);
+
+            /**
+             * @brief create the optimizers of the worker threads for a search
+             */
+            void createWorkers();
+
+            /**
+             * @brief keep the best directions as seeds of local refinement
+             * 
+             * @param normals 
+             * @param scores 
+             */
+            void setBestDirections(const std::vector<gemmi::Vec3>& normals, const std::vector<double>& scores);
+
+            /**
+             * @brief search for membrane normal by rotating the normal with
+             *        TMDET_BALL_DIST steps around the (half) sphere
+             */
+            void searchForMembraneNormalExhaustive();
+
+            /**
+             * @brief search for membrane normal on a coarse Fibonacci lattice
+             *        and refine the best directions with decreasing steps
+             */
+            void searchForMembraneNormalHierarchical();
+
+            /**
+             * @brief run both the exhaustive and the hierarchical search and
+             *        report their speed and the difference of their results
+             */
+            void benchmarkHierarchicalSearch();
+
             /**
              * @brief Get the width of the membrane (region of slices those qValue
              *        is above TMDET_MEMBRANE_VALUE)
@@ -187,6 +553,11 @@ namespace Tmdet::Engine {
              */
             void testMembraneNormalOne();
 
+            /**
+             * @brief calculate qValue from the already calculated residue distances
+             */
+            void testMembraneNormalDistances();
+
             /**
              * @brief check if tests resulted valid membrane definition
              *
@@ -227,11 +598,16 @@ namespace Tmdet::Engine {
                     init();
                 }
 
+            /**
+             * @brief Copy constructor (used for creating worker threads)
+             */
+            Optimizer(const Optimizer& other) = default;
+
             /**
              * @brief Destroy the Optim object
              * 
              */
-            ~Optimizer();
+            virtual ~Optimizer();
 
             /**
              * @brief set the membrane normal
@@ -263,6 +639,16 @@ namespace Tmdet::Engine {
              */
             void searchForMembraneNormal();
 
+            /**
+             * @brief refine the membrane normal by pattern search on the sphere
+             *        starting from the best directions of the search and from
+             *        the given axes (e.g. symmetry axes)
+             * 
+             * @param axes 
+             * @return unsigned long int number of tested normals
+             */
+            unsigned long int refineMembraneNormal(const std::vector<gemmi::Vec3>& axes);
+
             /**
              * @brief 
              */
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <memory>
+#include <chrono>
 
 #include <gemmi/metadata.hpp>
 
@@ -49,6 +50,9 @@ namespace Tmdet::Engine {
 
             if (!protein.tmp) {
                 optimizer->searchForMembraneNormal();
+                if (args.getValueAsBool("lr")) {
+                    refine();
+                }
                 optimizer->setMembranesToProtein();
             }
             if (protein.tmp) {
@@ -68,13 +72,21 @@ namespace Tmdet::Engine {
     }
 
     void Organizer::surface() {
-        auto surf = Tmdet::Utils::Surface(protein,args.getValueAsBool("nc"));
+        auto surf = Tmdet::Utils::Surface(protein,args.getValueAsBool("nc"),args.getValueAsInt("t"),args.getValueAsBool("sb"),args.getValueAsString("se"),!args.getValueAsBool("nos"),contacts,args.getValueAsBool("ss"));
+    }
+
+    void Organizer::refine() {
+        auto start = std::chrono::steady_clock::now();
+        auto tested = optimizer->refineMembraneNormal(symmetryAxes);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        INFO_LOG("Local refinement of membrane normal: {} normals tested in {} s",tested,elapsed.count());
     }
 
     void Organizer::checkSymmetry() {
         if (auto oligomerChains = Tmdet::Utils::Oligomer::getHomoOligomerEntities(protein.gemmi); !oligomerChains.empty()) {
             auto symmetry = Tmdet::Utils::Symmetry(protein);
             auto axes = symmetry.getMembraneAxes();
+            symmetryAxes = axes;
             for(auto& normal: axes) {
                 optimizer->setNormal(normal);
                 optimizer->clear();
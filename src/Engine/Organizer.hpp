@@ -13,6 +13,7 @@
 
 #include <Engine/Optimizer.hpp>
 #include <System/Arguments.hpp>
+#include <Utils/Surface.hpp>
 #include <VOs/Protein.hpp>
 #include <VOs/Chain.hpp>
 #include <VOs/Protein.hpp>
@@ -41,11 +42,22 @@ namespace Tmdet::Engine {
              */
             Tmdet::System::Arguments& args;
 
+            /**
+             * @brief stored surface contacts of the whole protein (fragment analysis)
+             */
+            Tmdet::Utils::surfaceContacts* contacts = nullptr;
+
             /**
              * @brief pointer to the optimizer object (curved or plain)
              */
             std::unique_ptr<Tmdet::Engine::Optimizer> optimizer;
 
+            /**
+             * @brief symmetry axes of the protein (if any), used as seeds of
+             *        the local refinement of membrane normal
+             */
+            std::vector<gemmi::Vec3> symmetryAxes;
+
             /**
              * @brief calculate the solvent accessible surface and outside surface
              *        of the selected chains
@@ -59,6 +71,11 @@ namespace Tmdet::Engine {
              */
             void checkSymmetry();
 
+            /**
+             * @brief refine the membrane normal found by the search
+             */
+            void refine();
+
             /**
              * @brief run the process
              */
@@ -70,10 +87,13 @@ namespace Tmdet::Engine {
              * 
              * @param protein the protein structure
              * @param args    command line arguments
+             * @param contacts stored surface contacts (used in fragment analysis)
              */
-            explicit Organizer(Tmdet::VOs::Protein& protein, Tmdet::System::Arguments& args) :
+            explicit Organizer(Tmdet::VOs::Protein& protein, Tmdet::System::Arguments& args,
+                Tmdet::Utils::surfaceContacts* contacts = nullptr) :
                 protein(protein),
-                args(args) {
+                args(args),
+                contacts(contacts) {
                     run();
             }
 
@@ -17,6 +17,31 @@ namespace Tmdet::Engine {
                 + normal.z * (vec.z - massCentre.z);
     }
 
+    void PlaneOptimizer::projectResidues() {
+        const Tmdet::real* x = residueCoords.x.data();
+        const Tmdet::real* y = residueCoords.y.data();
+        const Tmdet::real* z = residueCoords.z.data();
+        Tmdet::real* d = residueDistances.data();
+        const Tmdet::real nx = normal.x;
+        const Tmdet::real ny = normal.y;
+        const Tmdet::real nz = normal.z;
+        const Tmdet::real cx = massCentre.x;
+        const Tmdet::real cy = massCentre.y;
+        const Tmdet::real cz = massCentre.z;
+        const unsigned long int n = residueDistances.size();
+        for (unsigned long int i=0; i<n; i++) {
+            d[i] = nx * (x[i] - cx) + ny * (y[i] - cy) + nz * (z[i] - cz);
+        }
+    }
+
+    void PlaneOptimizer::testMembraneNormalProjected(const Tmdet::real* projection) {
+        std::copy(projection,projection+residueDistances.size(),residueDistances.begin());
+        for (auto i: emptyResidues) {
+            residueDistances[i] = 0.0;
+        }
+        testMembraneNormalDistances();
+    }
+
     double PlaneOptimizer::getAngle(Tmdet::VOs::SecStrVec& vector) {
         return std::abs(Tmdet::Helpers::Vector::cosAngle(normal,vector.end - vector.begin));
     }
@@ -29,6 +54,10 @@ namespace Tmdet::Engine {
         testMembraneNormalOne();
     }
 
+    std::unique_ptr<Optimizer> PlaneOptimizer::clone() const {
+        return std::make_unique<PlaneOptimizer>(*this);
+    }
+
     void PlaneOptimizer::setBestOrigo(double minz, double maxz) {
         //
     }
@@ -37,10 +37,30 @@ namespace Tmdet::Engine {
              */
             double distance(gemmi::Vec3& vec);
 
+            /**
+             * @brief calculate the distance of every residue coordinate
+             *        in residueCoords into residueDistances
+             */
+            void projectResidues();
+
+            /**
+             * @brief calculate qValue using the projections of block evaluation
+             * 
+             * @param projection 
+             */
+            void testMembraneNormalProjected(const Tmdet::real* projection);
+
             double getAngle(Tmdet::VOs::SecStrVec& vector);
 
             void testMembraneNormalFinal();
 
+            /**
+             * @brief create a copy of the optimizer for a worker thread
+             * 
+             * @return std::unique_ptr<Optimizer> 
+             */
+            std::unique_ptr<Optimizer> clone() const;
+
             /**
              * @brief Set place of the best origo
              * 
@@ -56,4 +56,34 @@ namespace Tmdet::Engine {
             q = 0;
         }
     }
+
+    std::vector<gemmi::Vec3> Rotator::fibonacciLattice(int n, bool fullSphere) {
+        std::vector<gemmi::Vec3> ret;
+        double goldenAngle = M_PI * (3.0 - sqrt(5.0));
+        double zRange = (fullSphere?2.0:1.0);
+        for (int i=0; i<n; i++) {
+            double z = 1.0 - zRange * (i + 0.5) / n;
+            double r = sqrt(1.0 - z * z);
+            double phi = goldenAngle * i;
+            ret.emplace_back(cos(phi) * r, sin(phi) * r, z);
+        }
+        return ret;
+    }
+
+    std::vector<gemmi::Vec3> Rotator::neighbours(const gemmi::Vec3& normal, double step, bool fullSphere) {
+        //orthonormal basis of the tangent plane
+        gemmi::Vec3 axis = (std::abs(normal.x) < 0.9 ? gemmi::Vec3(1,0,0) : gemmi::Vec3(0,1,0));
+        gemmi::Vec3 u = normal.cross(axis).normalized();
+        gemmi::Vec3 v = normal.cross(u);
+        std::vector<gemmi::Vec3> ret;
+        for (int i=0; i<6; i++) {
+            double phi = i * M_PI / 3;
+            gemmi::Vec3 vec = normal * cos(step) + (u * cos(phi) + v * sin(phi)) * sin(step);
+            if (!fullSphere && vec.z < 0) {
+                vec *= -1.0;
+            }
+            ret.push_back(vec.normalized());
+        }
+        return ret;
+    }
 }
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <vector>
 #include <gemmi/math.hpp>
 
 /**
@@ -91,5 +92,26 @@ namespace Tmdet::Engine {
             void end180() {
                 alpha_end = M_PI;
             }
+
+            /**
+             * @brief get nearly uniformly distributed unit vectors on the upper
+             *        hemisphere or on the whole sphere (Fibonacci lattice)
+             * 
+             * @param n number of vectors
+             * @param fullSphere
+             * @return std::vector<gemmi::Vec3> 
+             */
+            static std::vector<gemmi::Vec3> fibonacciLattice(int n, bool fullSphere);
+
+            /**
+             * @brief get the 6 unit vectors around the given normal vector in
+             *        the given angular distance (in radian)
+             * 
+             * @param normal 
+             * @param step 
+             * @param fullSphere if false vectors are flipped to the upper hemisphere
+             * @return std::vector<gemmi::Vec3> 
+             */
+            static std::vector<gemmi::Vec3> neighbours(const gemmi::Vec3& normal, double step, bool fullSphere);
     };
 }
@@ -0,0 +1,82 @@
+// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
+//             Protein Bioinformatics Research Group 
+//             Research Center of Natural Sciences, HUN-REN
+//
+// License:    CC-BY-NC-4.0, see LICENSE.txt
+
+#include <fstream>
+#include <filesystem>
+#include <format>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <Config.hpp>
+#include <System/Logger.hpp>
+#include <Utils/CacheFile.hpp>
+
+namespace Tmdet::Utils {
+
+    uint64_t cacheFile::checksum(const char* data, uint64_t size) {
+        uint64_t h = 14695981039346656037ULL;
+        auto bytes = reinterpret_cast<const unsigned char*>(data);
+        for (uint64_t i=0; i<size; i++) {
+            h ^= bytes[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    bool cacheFile::read(const std::string& path, const std::string& name, size_t minSize,
+        const std::function<bool(const char* map, size_t size)>& reader) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < minSize) {
+            close(fd);
+            return false;
+        }
+        size_t size = st.st_size;
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        bool valid = reader(reinterpret_cast<const char*>(map), size);
+        if (!valid) {
+            logger.warn("Invalid {} cache file, recalculating. Path: {}",name,path);
+        }
+        munmap(map, size);
+        return valid;
+    }
+
+    void cacheFile::write(const std::string& path, const std::string& name, const void* header,
+        size_t headerSize, const void* data, size_t dataSize) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+        //unique temporary name, so concurrent workers do not write the same file
+        std::string tmp = std::format("{}.{}.{}.tmp", path, getpid(),
+            std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out.is_open()) {
+            logger.warn("Could not write {} cache. Path: {}",name,tmp);
+            return;
+        }
+        out.write(reinterpret_cast<const char*>(header), headerSize);
+        out.write(reinterpret_cast<const char*>(data), dataSize);
+        out.close();
+        if (!out) {
+            logger.warn("Could not write {} cache. Path: {}",name,tmp);
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            logger.warn("Could not rename {} cache. Path: {}",name,path);
+            std::filesystem::remove(tmp, ec);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
+//             Protein Bioinformatics Research Group 
+//             Research Center of Natural Sciences, HUN-REN
+//
+// License:    CC-BY-NC-4.0, see LICENSE.txt
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief namespace for tmdet utils
+ */
+namespace Tmdet::Utils {
+
+    /**
+     * @brief common parts of the binary cache files (surface and
+     *        secondary structure cache)
+     */
+    struct cacheFile {
+
+        /**
+         * @brief FNV-1a checksum of the cache data
+         *
+         * @param data
+         * @param size in bytes
+         * @return uint64_t
+         */
+        static uint64_t checksum(const char* data, uint64_t size);
+
+        /**
+         * @brief Map the cache file read only and pass it to the reader
+         *
+         * @param path
+         * @param name of the cache in messages
+         * @param minSize minimal size of a valid file (size of the header)
+         * @param reader validates the mapped file and sets the data from it
+         * @return bool false if the file is missing or invalid
+         */
+        static bool read(const std::string& path, const std::string& name, size_t minSize,
+            const std::function<bool(const char* map, size_t size)>& reader);
+
+        /**
+         * @brief Write header and data to the cache file, using temporary
+         *        file and rename for atomic update
+         *
+         * @param path
+         * @param name of the cache in messages
+         * @param header
+         * @param headerSize
+         * @param data
+         * @param dataSize
+         */
+        static void write(const std::string& path, const std::string& name, const void* header,
+            size_t headerSize, const void* data, size_t dataSize);
+    };
+}
@@ -0,0 +1,224 @@
+// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
+//             Protein Bioinformatics Research Group 
+//             Research Center of Natural Sciences, HUN-REN
+//
+// License:    CC-BY-NC-4.0, see LICENSE.txt
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <gemmi/model.hpp>
+#include <gemmi/neighbor.hpp>
+#include <VOs/Protein.hpp>
+#include <Utils/CellList.hpp>
+
+namespace Tmdet::Utils {
+
+    void CellList::build(Tmdet::VOs::Protein& a_protein, double a_cellSize) {
+        protein = &a_protein;
+        cellSize = a_cellSize;
+        x.clear();
+        y.clear();
+        z.clear();
+        altloc.clear();
+        chainIdxs.clear();
+        residueIdxs.clear();
+        atomIdxs.clear();
+        firstAtom.clear();
+        for (int c=0; c<(int)protein->chains.size(); c++) {
+            firstAtom.emplace_back();
+            for (int r=0; r<(int)protein->chains[c].residues.size(); r++) {
+                firstAtom[c].push_back((int)x.size());
+                const auto& atoms = protein->chains[c].residues[r].atoms;
+                for (int a=0; a<(int)atoms.size(); a++) {
+                    const auto& pos = atoms[a].gemmi.pos;
+                    x.push_back(pos.x);
+                    y.push_back(pos.y);
+                    z.push_back(pos.z);
+                    altloc.push_back(atoms[a].gemmi.altloc);
+                    chainIdxs.push_back(c);
+                    residueIdxs.push_back(r);
+                    atomIdxs.push_back(a);
+                }
+            }
+        }
+        setCells();
+        setSelection();
+    }
+
+    void CellList::build(const std::vector<gemmi::Position>& positions, double a_cellSize) {
+        protein = nullptr;
+        cellSize = a_cellSize;
+        x.clear();
+        y.clear();
+        z.clear();
+        chainIdxs.clear();
+        residueIdxs.clear();
+        atomIdxs.clear();
+        firstAtom.clear();
+        for (const auto& pos: positions) {
+            x.push_back(pos.x);
+            y.push_back(pos.y);
+            z.push_back(pos.z);
+        }
+        altloc.assign(x.size(),0);
+        setCells();
+        setSelection();
+    }
+
+    void CellList::setCells() {
+        unsigned long int n = x.size();
+        if (n == 0) {
+            nx = ny = nz = 0;
+            cellStart.assign(1,0);
+            cellAtoms.clear();
+            return;
+        }
+        double xmax=-1e10, ymax=-1e10, zmax=-1e10;
+        xmin = ymin = zmin = 1e10;
+        for (unsigned long int i=0; i<n; i++) {
+            xmin = std::min(xmin,x[i]);
+            ymin = std::min(ymin,y[i]);
+            zmin = std::min(zmin,z[i]);
+            xmax = std::max(xmax,x[i]);
+            ymax = std::max(ymax,y[i]);
+            zmax = std::max(zmax,z[i]);
+        }
+        //cells are enlarged for sparse structures to limit memory usage
+        auto cells = [&]() -> double {
+            return ((xmax - xmin) / cellSize + 1) * ((ymax - ymin) / cellSize + 1) * ((zmax - zmin) / cellSize + 1);
+        };
+        while (cells() > 8.0 * n + 1000) {
+            cellSize *= 1.25;
+        }
+        nx = (int)((xmax - xmin) / cellSize) + 1;
+        ny = (int)((ymax - ymin) / cellSize) + 1;
+        nz = (int)((zmax - zmin) / cellSize) + 1;
+        //counting sort of the atoms into cells
+        std::vector<unsigned int> cellOfAtom(n);
+        cellStart.assign((unsigned long int)nx * ny * nz + 1, 0);
+        for (unsigned long int i=0; i<n; i++) {
+            cellOfAtom[i] = (cell(z[i],zmin,nz) * ny + cell(y[i],ymin,ny)) * nx + cell(x[i],xmin,nx);
+            cellStart[cellOfAtom[i] + 1]++;
+        }
+        for (unsigned long int i=1; i<cellStart.size(); i++) {
+            cellStart[i] += cellStart[i-1];
+        }
+        cellAtoms.resize(n);
+        std::vector<unsigned int> next(cellStart.begin(), cellStart.end() - 1);
+        for (unsigned long int i=0; i<n; i++) {
+            cellAtoms[next[cellOfAtom[i]]++] = (int)i;
+        }
+    }
+
+    void CellList::setSelection() {
+        //table built from positions: every point is selected
+        if (protein == nullptr) {
+            mask.assign((x.size() + 63) / 64, ~uint64_t(0));
+            return;
+        }
+        mask.assign((x.size() + 63) / 64, 0);
+        for (unsigned long int i=0; i<x.size(); i++) {
+            const auto& chain = protein->chains[chainIdxs[i]];
+            if (chain.selected && chain.residues[residueIdxs[i]].selected) {
+                mask[i >> 6] |= uint64_t(1) << (i & 63);
+            }
+        }
+    }
+
+    int CellList::cell(double v, double vmin, int n) const {
+        int i = (int)floor((v - vmin) / cellSize);
+        return (i<0?0:(i>=n?n-1:i));
+    }
+
+    void CellList::append(const gemmi::Position& pos, char a_altloc, double minDist, double maxDist, std::vector<int>& ids) const {
+        if (nx == 0) {
+            return;
+        }
+        const double min2 = minDist * minDist;
+        const double max2 = maxDist * maxDist;
+        const int xbeg = cell(pos.x - maxDist,xmin,nx);
+        const int xend = cell(pos.x + maxDist,xmin,nx);
+        const int ybeg = cell(pos.y - maxDist,ymin,ny);
+        const int yend = cell(pos.y + maxDist,ymin,ny);
+        const int zbeg = cell(pos.z - maxDist,zmin,nz);
+        const int zend = cell(pos.z + maxDist,zmin,nz);
+        const unsigned long int beg = ids.size();
+        for (int k=zbeg; k<=zend; k++) {
+            for (int j=ybeg; j<=yend; j++) {
+                //cells of a row are contiguous
+                const unsigned int c = (k * ny + j) * nx;
+                for (unsigned int l=cellStart[c + xbeg]; l<cellStart[c + xend + 1]; l++) {
+                    const int i = cellAtoms[l];
+                    const double dx = x[i] - pos.x;
+                    const double dy = y[i] - pos.y;
+                    const double dz = z[i] - pos.z;
+                    const double d2 = dx * dx + dy * dy + dz * dz;
+                    if (d2 < max2 && d2 >= min2 && selected(i)
+                        && (a_altloc == 0 || altloc[i] == 0 || a_altloc == altloc[i])) {
+                        ids.push_back(i);
+                    }
+                }
+            }
+        }
+        std::sort(ids.begin() + beg, ids.end());
+    }
+
+    void CellList::find(const gemmi::Position& pos, char a_altloc, double minDist, double maxDist, std::vector<int>& ids) const {
+        ids.clear();
+        append(pos,a_altloc,minDist,maxDist,ids);
+    }
+
+    void CellList::find(const std::vector<gemmi::Position>& positions, const std::vector<char>& altlocs,
+        double minDist, double maxDist, std::vector<unsigned int>& offsets, std::vector<int>& ids) const {
+        offsets.clear();
+        ids.clear();
+        offsets.push_back(0);
+        for (unsigned long int i=0; i<positions.size(); i++) {
+            append(positions[i],altlocs[i],minDist,maxDist,ids);
+            offsets.push_back(ids.size());
+        }
+    }
+
+    void CellList::benchmark(Tmdet::VOs::Protein& protein) {
+        const double radius = 7.0;
+        std::vector<const gemmi::Atom*> atoms;
+        protein.eachSelectedResidue(
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                for(const auto& atom: residue.atoms) {
+                    atoms.push_back(&atom.gemmi);
+                }
+            }
+        );
+        unsigned long int gemmiHits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (auto atom: atoms) {
+            for(auto m : protein.neighbors.find_neighbors(*atom, 0.1, radius)) {
+                if (protein.chains[m->chain_idx].selected
+                    && protein.chains[m->chain_idx].residues[m->residue_idx].selected) {
+                    auto& b_atom = protein.chains[m->chain_idx].residues[m->residue_idx].atoms[m->atom_idx];
+                    gemmiHits += (atom->pos.dist(b_atom.gemmi.pos) < radius);
+                }
+            }
+        }
+        std::chrono::duration<double> gemmiTime = std::chrono::steady_clock::now() - start;
+        start = std::chrono::steady_clock::now();
+        CellList cellList(protein,radius);
+        std::chrono::duration<double> buildTime = std::chrono::steady_clock::now() - start;
+        unsigned long int cellHits = 0;
+        std::vector<int> ids;
+        start = std::chrono::steady_clock::now();
+        for (auto atom: atoms) {
+            cellList.find(*atom,0.1,radius,ids);
+            cellHits += ids.size();
+        }
+        std::chrono::duration<double> cellTime = std::chrono::steady_clock::now() - start;
+        std::cout << "Neighbor search benchmark (" << protein.code << ", "
+            << atoms.size() << " atoms, radius: " << radius << ")" << std::endl;
+        std::cout << "  gemmi neighbor search: " << gemmiTime.count() << " s, neighbors: " << gemmiHits << std::endl;
+        std::cout << "  cell list:             " << cellTime.count() << " s (build: " << buildTime.count()
+            << " s), neighbors: " << cellHits << std::endl;
+        std::cout << "  speedup: " << (cellTime.count()>0?gemmiTime.count()/cellTime.count():0.0) << std::endl;
+    }
+}
@@ -0,0 +1,230 @@
+// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
+//             Protein Bioinformatics Research Group 
+//             Research Center of Natural Sciences, HUN-REN
+//
+// License:    CC-BY-NC-4.0, see LICENSE.txt
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <gemmi/model.hpp>
+#include <VOs/Protein.hpp>
+
+/**
+ * @brief namespace for tmdet utils
+ */
+namespace Tmdet::Utils {
+
+    /**
+     * @brief spatial index of the atoms of the protein: flat atom table
+     *        (structure of arrays) sorted into cubic cells, atoms are
+     *        identified by their index in the table
+     */
+    class CellList {
+        private:
+            /**
+             * @brief protein value object the index is built on
+             */
+            Tmdet::VOs::Protein* protein = nullptr;
+
+            /**
+             * @brief coordinates and alternative location of the atoms
+             */
+            std::vector<double> x;
+            std::vector<double> y;
+            std::vector<double> z;
+            std::vector<char> altloc;
+
+            /**
+             * @brief chain, residue and atom index of the atoms
+             */
+            std::vector<int> chainIdxs;
+            std::vector<int> residueIdxs;
+            std::vector<int> atomIdxs;
+
+            /**
+             * @brief id of the first atom of residues [chain][residue]
+             */
+            std::vector<std::vector<int>> firstAtom;
+
+            /**
+             * @brief selected atoms, one bit for each atom
+             */
+            std::vector<uint64_t> mask;
+
+            /**
+             * @brief grid parameters
+             */
+            double cellSize = 1.0;
+            double xmin = 0.0;
+            double ymin = 0.0;
+            double zmin = 0.0;
+            int nx = 0;
+            int ny = 0;
+            int nz = 0;
+
+            /**
+             * @brief atoms of cell i are cellAtoms[cellStart[i]..cellStart[i+1])
+             */
+            std::vector<unsigned int> cellStart;
+            std::vector<int> cellAtoms;
+
+            /**
+             * @brief Grid index of a coordinate
+             *
+             * @param v coordinate
+             * @param vmin minimum of the grid
+             * @param n number of cells
+             * @return int
+             */
+            int cell(double v, double vmin, int n) const;
+
+            /**
+             * @brief Set grid parameters and sort the points of the table into cells
+             */
+            void setCells();
+
+            /**
+             * @brief Append the ids of selected atoms in the distance range
+             *        of a position to ids (in increasing order)
+             *
+             * @param pos
+             * @param altloc
+             * @param minDist
+             * @param maxDist
+             * @param ids
+             */
+            void append(const gemmi::Position& pos, char altloc, double minDist, double maxDist, std::vector<int>& ids) const;
+
+        public:
+            CellList() = default;
+
+            /**
+             * @brief Construct a new cell list object
+             *
+             * @param protein
+             * @param cellSize edge of the cells, it should be about the query radius
+             */
+            explicit CellList(Tmdet::VOs::Protein& protein, double cellSize) {
+                build(protein, cellSize);
+            }
+
+            /**
+             * @brief Build the atom table and the cells from the actual coordinates
+             *
+             * @param protein
+             * @param cellSize
+             */
+            void build(Tmdet::VOs::Protein& protein, double cellSize);
+
+            /**
+             * @brief Build the table from a list of positions, the id of a point
+             *        is its index in the list (atom and residue accessors
+             *        can not be used)
+             *
+             * @param positions
+             * @param cellSize
+             */
+            void build(const std::vector<gemmi::Position>& positions, double cellSize);
+
+            /**
+             * @brief Update selected atoms from the protein selection
+             *        (all points are selected if built from positions)
+             */
+            void setSelection();
+
+            /**
+             * @brief Number of atoms in the table
+             *
+             * @return int
+             */
+            int size() const {
+                return (int)x.size();
+            }
+
+            /**
+             * @brief Id of an atom given by its chain, residue and atom index
+             */
+            int id(int chainIdx, int residueIdx, int atomIdx) const {
+                return firstAtom[chainIdx][residueIdx] + atomIdx;
+            }
+
+            int id(const Tmdet::VOs::Atom& atom) const {
+                return firstAtom[atom.chainIdx][atom.residueIdx] + atom.idx;
+            }
+
+            /**
+             * @brief Check if atom is selected
+             */
+            bool selected(int id) const {
+                return (mask[id >> 6] >> (id & 63)) & 1;
+            }
+
+            int chainIdx(int id) const {
+                return chainIdxs[id];
+            }
+
+            int residueIdx(int id) const {
+                return residueIdxs[id];
+            }
+
+            /**
+             * @brief Atom and residue value objects of an atom id
+             */
+            Tmdet::VOs::Atom& atom(int id) const {
+                return protein->chains[chainIdxs[id]].residues[residueIdxs[id]].atoms[atomIdxs[id]];
+            }
+
+            Tmdet::VOs::Residue& residue(int id) const {
+                return protein->chains[chainIdxs[id]].residues[residueIdxs[id]];
+            }
+
+            /**
+             * @brief Find selected atoms in the given distance range of a position,
+             *        atoms in other alternative location than altloc are skipped
+             *
+             * @param pos
+             * @param altloc alternative location of the query (0: any)
+             * @param minDist
+             * @param maxDist
+             * @param ids result atom ids in increasing order (container is reused)
+             */
+            void find(const gemmi::Position& pos, char altloc, double minDist, double maxDist, std::vector<int>& ids) const;
+
+            /**
+             * @brief Find selected atoms in the given distance range of an atom
+             *
+             * @param atom
+             * @param minDist
+             * @param maxDist
+             * @param ids
+             */
+            void find(const gemmi::Atom& atom, double minDist, double maxDist, std::vector<int>& ids) const {
+                find(atom.pos, atom.altloc, minDist, maxDist, ids);
+            }
+
+            /**
+             * @brief Batched query: find selected atoms in the given distance range
+             *        of each position, results of position i are
+             *        ids[offsets[i]..offsets[i+1])
+             *
+             * @param positions
+             * @param altlocs alternate location of each position
+             * @param minDist
+             * @param maxDist
+             * @param offsets
+             * @param ids
+             */
+            void find(const std::vector<gemmi::Position>& positions, const std::vector<char>& altlocs,
+                double minDist, double maxDist, std::vector<unsigned int>& offsets, std::vector<int>& ids) const;
+
+            /**
+             * @brief Compare the query cost of gemmi neighbor search and
+             *        cell list for the selected atoms
+             *
+             * @param protein
+             */
+            static void benchmark(Tmdet::VOs::Protein& protein);
+    };
+}
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <sstream>
 #include <array>
+#include <chrono>
 #include <math.h>
 #include <gemmi/model.hpp>
 #include <gemmi/neighbor.hpp>
@@ -29,57 +30,37 @@ namespace Tmdet::Utils {
 #define DSSP_HBHIGH -500
 
     void Dssp::exec() {
-        init();
-        protein.eachSelectedChain(
+        protein.eachSelectedChainInParallel(numThreads,
             [&](Tmdet::VOs::Chain& chain) -> void {
-                calcDsspOnChain(chain);
+                Dssp worker(protein, useGrid);
+                worker.calcDsspOnChain(chain);
             }
         );
-        end();
     }
 
-    void Dssp::init() {
-        protein.eachResidue(
-            [](Tmdet::VOs::Residue& residue) -> void {
-                residue.temp.try_emplace("hbond1",std::any(Tmdet::VOs::HBond()));
-                residue.temp.try_emplace("hbond2",std::any(Tmdet::VOs::HBond()));
-                residue.temp.try_emplace("t3",std::any(' '));
-                residue.temp.try_emplace("t4",std::any(' '));
-                residue.temp.try_emplace("t5",std::any(' '));
-                residue.temp.try_emplace("pb",std::any(-1));
-                residue.temp.try_emplace("apb",std::any(-1));
-            }
-        );
-    }
-
-    void Dssp::end() {
-        protein.eachResidue(
-            [](Tmdet::VOs::Residue& residue) -> void {
-                residue.temp.erase("hbond2");
-                residue.temp.erase("t3");
-                residue.temp.erase("t4");
-                residue.temp.erase("t5");
-                residue.temp.erase("pb");
-                residue.temp.erase("apb");
-            }
-        );
+    void Dssp::initStates(Tmdet::VOs::Chain& chain) {
+        states.assign(chain.residues.size(),dsspState());
     }
 
     void Dssp::calcDsspOnChain(Tmdet::VOs::Chain& chain) {
+        initStates(chain);
         createHydrogenBonds(chain);
-        detectTurns(chain,3,"t3");
-        detectTurns(chain,4,"t4");
-        detectTurns(chain,5,"t5");
+        detectTurns(chain,3);
+        detectTurns(chain,4);
+        detectTurns(chain,5);
         initPbs(chain);
-        detectSecStructH(chain,"t4");
-        detectSecStructG(chain,"t3");
-        detectSecStructI(chain,"t5");
+        detectSecStructH(chain);
+        detectSecStructG(chain);
+        detectSecStructI(chain);
         detectSecStructT(chain);
         detectSecStructS(chain);
         detectSecStructBE(chain);
     }
 
     void Dssp::createHydrogenBonds(Tmdet::VOs::Chain& chain) {
+        if (useGrid) {
+            setCaList(chain);
+        }
         for(int i=1; i<chain.length; i++) {
             if (chain.orderDistance(i-1,i) == 1) {
                 auto& gres = chain.residues[i].gemmi;
@@ -101,59 +82,131 @@ namespace Tmdet::Utils {
         }
     }
 
+    void Dssp::setCaList(Tmdet::VOs::Chain& chain) {
+        std::vector<gemmi::Position> positions;
+        caResidues.clear();
+        for(int r=0; r<chain.length; r++) {
+            if (auto CA = chain.residues[r].gemmi.get_ca(); CA != (Atom *)nullptr) {
+                positions.push_back(CA->pos);
+                caResidues.push_back(r);
+            }
+        }
+        caList.build(positions,9.0);
+    }
+
     void Dssp::scanNeighbors(Tmdet::VOs::Chain& chain, int r1, const gemmi::Atom* CA, const gemmi::Atom* N, gemmi::Position hcoord) {
+        if (!useGrid) {
+            scanNeighborsReference(chain, r1, CA, N, hcoord);
+            return;
+        }
+        //ids are in increasing order, so acceptors are tested in the same
+        //order as in the reference implementation (the query radius is a bit
+        //larger, the exact cutoff is checked in checkHydrogenBond)
+        caList.find(CA->pos, 0, 0.0, 9.01, ids);
+        for(auto id: ids) {
+            checkHydrogenBond(chain, r1, caResidues[id], CA, N, hcoord);
+        }
+    }
+
+    void Dssp::scanNeighborsReference(Tmdet::VOs::Chain& chain, int r1, const gemmi::Atom* CA, const gemmi::Atom* N, gemmi::Position hcoord) {
         for(int r2=0; r2<chain.length; r2++) {
-            if (std::abs(chain.orderDistance(r1,r2)) > 1) {
-                auto CB = chain.residues[r2].gemmi.get_ca();
-                if (CB != (Atom *)nullptr && CA->pos.dist(CB->pos) < 9.0) {
-                    auto C = chain.residues[r2].gemmi.get_c();
-                    auto O = chain.residues[r2].gemmi.find_atom("O",' ');
-                    if (C != (Atom *)nullptr && O != (Atom *)nullptr) {
-                        double dho = hcoord.dist(O->pos);
-                        double dhc = hcoord.dist(C->pos);
-                        double dno = N->pos.dist(O->pos);
-                        double dnc = N->pos.dist(C->pos);
-                        double energy;
-                        if (dho<DSSP_PDB_DL||dhc<DSSP_PDB_DL||dno<DSSP_PDB_DL||dnc<DSSP_PDB_DL) {
-                            setHydrogenBond(chain.residues[r2],chain.residues[r1],DSSP_HBLOW);
-                        }
-                        else if ((energy=DSSP_Q/dho-DSSP_Q/dhc+DSSP_Q/dnc-DSSP_Q/dno+0.5)<DSSP_HBHIGH) {
-                            setHydrogenBond(chain.residues[r2],chain.residues[r1],energy);
-                        }
+            checkHydrogenBond(chain, r1, r2, CA, N, hcoord);
+        }
+    }
+
+    void Dssp::checkHydrogenBond(Tmdet::VOs::Chain& chain, int r1, int r2, const gemmi::Atom* CA, const gemmi::Atom* N, const gemmi::Position& hcoord) {
+        if (std::abs(chain.orderDistance(r1,r2)) > 1) {
+            auto CB = chain.residues[r2].gemmi.get_ca();
+            if (CB != (Atom *)nullptr && CA->pos.dist(CB->pos) < 9.0) {
+                auto C = chain.residues[r2].gemmi.get_c();
+                auto O = chain.residues[r2].gemmi.find_atom("O",' ');
+                if (C != (Atom *)nullptr && O != (Atom *)nullptr) {
+                    double dho = hcoord.dist(O->pos);
+                    double dhc = hcoord.dist(C->pos);
+                    double dno = N->pos.dist(O->pos);
+                    double dnc = N->pos.dist(C->pos);
+                    double energy;
+                    if (dho<DSSP_PDB_DL||dhc<DSSP_PDB_DL||dno<DSSP_PDB_DL||dnc<DSSP_PDB_DL) {
+                        setHydrogenBond(r2,chain.residues[r1],DSSP_HBLOW);
+                    }
+                    else if ((energy=DSSP_Q/dho-DSSP_Q/dhc+DSSP_Q/dnc-DSSP_Q/dno+0.5)<DSSP_HBHIGH) {
+                        setHydrogenBond(r2,chain.residues[r1],energy);
                     }
                 }
             }
         }
     }
 
-    void Dssp::setHydrogenBond(Tmdet::VOs::Residue& donor, Tmdet::VOs::Residue& akceptor, double energy) {
-        if (energy < any_cast<Tmdet::VOs::HBond>(donor.temp["hbond1"]).energy) {
-            donor.temp["hbond2"] = donor.temp["hbond1"];
-            donor.temp["hbond1"] = std::any(Tmdet::VOs::HBond({energy, akceptor.chainIdx, akceptor.idx}));
+    void Dssp::benchmark() {
+        std::cout << "Hydrogen bond search benchmark (" << protein.code << ")" << std::endl;
+        double allTime = 0.0;
+        double gridTime = 0.0;
+        std::vector<Tmdet::VOs::HBond> reference;
+        protein.eachSelectedChain(
+            [&](Tmdet::VOs::Chain& chain) -> void {
+                auto run = [&](bool grid) -> double {
+                    initStates(chain);
+                    useGrid = grid;
+                    auto start = std::chrono::steady_clock::now();
+                    createHydrogenBonds(chain);
+                    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+                    return time.count();
+                };
+                double t1 = run(false);
+                reference.clear();
+                for(const auto& state: states) {
+                    reference.push_back(state.hbond1);
+                    reference.push_back(state.hbond2);
+                }
+                double t2 = run(true);
+                int diffs = 0;
+                for(unsigned long int i=0; i<states.size(); i++) {
+                    for(int k=0; k<2; k++) {
+                        const auto& h1 = reference[2*i+k];
+                        const auto& h2 = (k==0?states[i].hbond1:states[i].hbond2);
+                        diffs += (h1.energy != h2.energy || h1.toChainIdx != h2.toChainIdx || h1.toResIdx != h2.toResIdx);
+                    }
+                }
+                std::cout << "  chain " << chain.id << " (" << chain.length << " residues): all pairs: "
+                    << t1 << " s, grid: " << t2 << " s, different hydrogen bonds: " << diffs << std::endl;
+                allTime += t1;
+                gridTime += t2;
+            }
+        );
+        std::cout << "  total: all pairs: " << allTime << " s, grid: " << gridTime << " s, speedup: "
+            << (gridTime>0?allTime/gridTime:0.0) << std::endl;
+        useGrid = true;
+    }
+
+    void Dssp::setHydrogenBond(int donor, Tmdet::VOs::Residue& akceptor, double energy) {
+        auto& state = states[donor];
+        if (energy < state.hbond1.energy) {
+            state.hbond2 = state.hbond1;
+            state.hbond1 = Tmdet::VOs::HBond({energy, akceptor.chainIdx, akceptor.idx});
         }
-        else if (energy< any_cast<Tmdet::VOs::HBond>(donor.temp["hbond2"]).energy) {
-            donor.temp["hbond2"] = std::any(Tmdet::VOs::HBond({energy, akceptor.chainIdx, akceptor.idx}));
+        else if (energy < state.hbond2.energy) {
+            state.hbond2 = Tmdet::VOs::HBond({energy, akceptor.chainIdx, akceptor.idx});
         }
     }
 
-    void Dssp::detectTurns(Tmdet::VOs::Chain& chain, int d, string key) {
+    void Dssp::detectTurns(Tmdet::VOs::Chain& chain, int d) {
         for(auto i=0; i<chain.length-d; i++) {
             if (chain.orderDistance(i+d,i) == d &&
-                (checkHbond1(chain, chain.residues[i],d) || checkHbond2(chain, chain.residues[i],d))) {
-                chain.residues[i].temp[key] = (any_cast<char>(chain.residues[i].temp[key]) == '<'?'x':'>');
+                (checkHbond1(chain,i,d) || checkHbond2(chain,i,d))) {
+                states[i].turn(d) = (states[i].turn(d) == '<'?'x':'>');
                 for(int j=1; j<d; j++) {
-                    if (any_cast<char>(chain.residues[i+j].temp[key]) == ' ') {
-                        chain.residues[i+j].temp[key] = '*';
+                    if (states[i+j].turn(d) == ' ') {
+                        states[i+j].turn(d) = '*';
                     }
                 }
-                chain.residues[i+d].temp[key] = '<';
+                states[i+d].turn(d) = '<';
             }
         }
         for(auto i=1; i<chain.length-1; i++) {
             if (chain.orderDistance(i-1,i) == 1 && chain.orderDistance(i,i+1) == 1) {
-                auto& dtmpm = any_cast<char&>(chain.residues[i-1].temp[key]);
-                auto& dtmp = any_cast<char&>(chain.residues[i].temp[key]);
-                auto& dtmpp = any_cast<char&>(chain.residues[i+1].temp[key]);
+                auto& dtmpm = states[i-1].turn(d);
+                auto& dtmp = states[i].turn(d);
+                auto& dtmpp = states[i+1].turn(d);
                 if ((dtmpm != '*' && dtmp == '*' && dtmpp != '*') &&
                     (dtmpm == 'x' || dtmpp == 'x')) {
                         if (dtmpm == '>') { dtmp = '>'; }
@@ -165,60 +218,80 @@ namespace Tmdet::Utils {
         }
     }
 
-    bool Dssp::checkHbond1(Tmdet::VOs::Chain& chain, Tmdet::VOs::Residue& res, int d) {
-        return (res.chainIdx == any_cast<Tmdet::VOs::HBond>(res.temp["hbond1"]).toChainIdx && 
-            chain.orderDistance(res.idx, any_cast<Tmdet::VOs::HBond>(res.temp["hbond1"]).toResIdx) == d);
+    bool Dssp::checkHbond1(Tmdet::VOs::Chain& chain, int i, int d) {
+        const auto& res = chain.residues[i];
+        return (res.chainIdx == states[i].hbond1.toChainIdx && 
+            chain.orderDistance(res.idx, states[i].hbond1.toResIdx) == d);
     }
 
-    bool Dssp::checkHbond2(Tmdet::VOs::Chain& chain, Tmdet::VOs::Residue& res, int d) {
-        return (res.chainIdx == any_cast<Tmdet::VOs::HBond>(res.temp["hbond2"]).toChainIdx && 
-            chain.orderDistance(res.idx, any_cast<Tmdet::VOs::HBond>(res.temp["hbond2"]).toResIdx) == d);
+    bool Dssp::checkHbond2(Tmdet::VOs::Chain& chain, int i, int d) {
+        const auto& res = chain.residues[i];
+        return (res.chainIdx == states[i].hbond2.toChainIdx && 
+            chain.orderDistance(res.idx, states[i].hbond2.toResIdx) == d);
     }
 
     void Dssp::initPbs(Tmdet::VOs::Chain& chain) {
+        //a bridge partner j of residue i is always a hydrogen bond partner
+        //of i-1 or i (pb: j or j+1, apb: j or j+1 is the partner), so only
+        //these candidates are checked; the largest valid j is kept as in
+        //the all pairs scan
         int n = chain.length;
         for(int i=1; i<n-1; i++) {
-            for(int j=1; j<n-1; j++) {
-                if (abs(i-j) > 2) {
-                    if (checkPb(chain,i,j)) {
-                        chain.residues[i].temp["pb"] = any_cast<int>(chain.residues[j].idx);
-                    }
-                    if (checkApb(chain,i,j)) {
-                        chain.residues[i].temp["apb"] = any_cast<int>(chain.residues[j].idx);
-                    }
+            const auto& prev = states[i-1];
+            const auto& act = states[i];
+            const std::array<int,4> pbs = {
+                prev.hbond1.toResIdx, prev.hbond2.toResIdx,
+                act.hbond1.toResIdx - 1, act.hbond2.toResIdx - 1
+            };
+            const std::array<int,4> apbs = {
+                act.hbond1.toResIdx, act.hbond2.toResIdx,
+                prev.hbond1.toResIdx - 1, prev.hbond2.toResIdx - 1
+            };
+            auto valid = [&](int j) -> bool {
+                return j>=1 && j<n-1 && abs(i-j) > 2;
+            };
+            for(auto j: pbs) {
+                if (valid(j) && j > states[i].pb && checkPb(chain,i,j)) {
+                    states[i].pb = chain.residues[j].idx;
+                }
+            }
+            for(auto j: apbs) {
+                if (valid(j) && j > states[i].apb && checkApb(chain,i,j)) {
+                    states[i].apb = chain.residues[j].idx;
                 }
             }
         }
     }
 
     bool Dssp::checkPb(Tmdet::VOs::Chain& chain, int i, int j) {
-        return (((any_cast<Tmdet::VOs::HBond>(chain.residues[i-1].temp["hbond1"]).toResIdx == chain.residues[j].idx ||
-                any_cast<Tmdet::VOs::HBond>(chain.residues[i-1].temp["hbond2"]).toResIdx == chain.residues[j].idx) &&
-                (any_cast<Tmdet::VOs::HBond>(chain.residues[j].temp["hbond1"]).toResIdx == chain.residues[i+1].idx ||
-                any_cast<Tmdet::VOs::HBond>(chain.residues[j].temp["hbond2"]).toResIdx == chain.residues[i+1].idx)) ||
-                ((any_cast<Tmdet::VOs::HBond>(chain.residues[j-1].temp["hbond1"]).toResIdx == chain.residues[i].idx || 
-                any_cast<Tmdet::VOs::HBond>(chain.residues[j-1].temp["hbond2"]).toResIdx == chain.residues[i].idx) &&
-                (any_cast<Tmdet::VOs::HBond>(chain.residues[i].temp["hbond1"]).toResIdx == chain.residues[j+1].idx ||
-                any_cast<Tmdet::VOs::HBond>(chain.residues[i].temp["hbond2"]).toResIdx == chain.residues[j+1].idx)));
+        return (((states[i-1].hbond1.toResIdx == chain.residues[j].idx ||
+                states[i-1].hbond2.toResIdx == chain.residues[j].idx) &&
+                (states[j].hbond1.toResIdx == chain.residues[i+1].idx ||
+                states[j].hbond2.toResIdx == chain.residues[i+1].idx)) ||
+                ((states[j-1].hbond1.toResIdx == chain.residues[i].idx || 
+                states[j-1].hbond2.toResIdx == chain.residues[i].idx) &&
+                (states[i].hbond1.toResIdx == chain.residues[j+1].idx ||
+                states[i].hbond2.toResIdx == chain.residues[j+1].idx)));
     }
 
     bool Dssp::checkApb(Tmdet::VOs::Chain& chain, int i, int j) {
-        return  (((any_cast<Tmdet::VOs::HBond>(chain.residues[i].temp["hbond1"]).toResIdx == chain.residues[j].idx ||
-                    any_cast<Tmdet::VOs::HBond>(chain.residues[i].temp["hbond2"]).toResIdx == chain.residues[j].idx) &&
-                    (any_cast<Tmdet::VOs::HBond>(chain.residues[j].temp["hbond1"]).toResIdx == chain.residues[i].idx ||
-                    any_cast<Tmdet::VOs::HBond>(chain.residues[j].temp["hbond2"]).toResIdx == chain.residues[i].idx)) ||
-                    ((any_cast<Tmdet::VOs::HBond>(chain.residues[i-1].temp["hbond1"]).toResIdx == chain.residues[j+1].idx ||
-                    any_cast<Tmdet::VOs::HBond>(chain.residues[i-1].temp["hbond2"]).toResIdx == chain.residues[j+1].idx) &&
-                    (any_cast<Tmdet::VOs::HBond>(chain.residues[i+1].temp["hbond1"]).toResIdx == chain.residues[j-1].idx ||
-                    any_cast<Tmdet::VOs::HBond>(chain.residues[i+1].temp["hbond2"]).toResIdx == chain.residues[j-1].idx)));
+        return  (((states[i].hbond1.toResIdx == chain.residues[j].idx ||
+                    states[i].hbond2.toResIdx == chain.residues[j].idx) &&
+                    (states[j].hbond1.toResIdx == chain.residues[i].idx ||
+                    states[j].hbond2.toResIdx == chain.residues[i].idx)) ||
+                    ((states[i-1].hbond1.toResIdx == chain.residues[j+1].idx ||
+                    states[i-1].hbond2.toResIdx == chain.residues[j+1].idx) &&
+                    (states[i+1].hbond1.toResIdx == chain.residues[j-1].idx ||
+                    states[i+1].hbond2.toResIdx == chain.residues[j-1].idx)));
     }
 
-    void Dssp::detectSecStructH(Tmdet::VOs::Chain& chain,string key) {
+    void Dssp::detectSecStructH(Tmdet::VOs::Chain& chain) {
+        const int d = 4;
         for( int i=1; i<chain.length-4; i++) {
-            if (((any_cast<char>(chain.residues[i].temp[key])=='>') || 
-                (any_cast<char>(chain.residues[i].temp[key])=='x')) &&
-                ((any_cast<char>(chain.residues[i-1].temp[key])=='>') || 
-                (any_cast<char>(chain.residues[i-1].temp[key])=='x'))) {
+            if (((states[i].turn(d)=='>') || 
+                (states[i].turn(d)=='x')) &&
+                ((states[i-1].turn(d)=='>') || 
+                (states[i-1].turn(d)=='x'))) {
                     for(int j=0; j<4; j++) {
                         chain.residues[i+j].ss = Tmdet::Types::SecStructType::H;
                     }
@@ -226,12 +299,13 @@ namespace Tmdet::Utils {
         }
     }
 
-    void Dssp::detectSecStructG(Tmdet::VOs::Chain& chain,string key) {
+    void Dssp::detectSecStructG(Tmdet::VOs::Chain& chain) {
+        const int d = 3;
         for( int i=1; i<chain.length-3; i++) {
-            if (((any_cast<char>(chain.residues[i].temp[key])=='>') || 
-                (any_cast<char>(chain.residues[i].temp[key])=='x')) &&
-                ((any_cast<char>(chain.residues[i-1].temp[key])=='>') || 
-                (any_cast<char>(chain.residues[i-1].temp[key])=='x')) &&
+            if (((states[i].turn(d)=='>') || 
+                (states[i].turn(d)=='x')) &&
+                ((states[i-1].turn(d)=='>') || 
+                (states[i-1].turn(d)=='x')) &&
                 checkIfAreOther(chain,Tmdet::Types::SecStructType::G,i,3)) {
                     for(int j=0; j<3; j++) {
                         chain.residues[i+j].ss = Tmdet::Types::SecStructType::G;
@@ -240,12 +314,13 @@ namespace Tmdet::Utils {
         }
     }
 
-    void Dssp::detectSecStructI(Tmdet::VOs::Chain& chain,string key) {
+    void Dssp::detectSecStructI(Tmdet::VOs::Chain& chain) {
+        const int d = 5;
         for( int i=1; i<chain.length-5; i++) {
-            if (((any_cast<char>(chain.residues[i].temp[key])=='>') || 
-                (any_cast<char>(chain.residues[i].temp[key])=='x')) &&
-                ((any_cast<char>(chain.residues[i-1].temp[key])=='>') || 
-                (any_cast<char>(chain.residues[i-1].temp[key])=='x')) &&
+            if (((states[i].turn(d)=='>') || 
+                (states[i].turn(d)=='x')) &&
+                ((states[i-1].turn(d)=='>') || 
+                (states[i-1].turn(d)=='x')) &&
                 checkIfAreOther(chain,Tmdet::Types::SecStructType::I,i,5)) {
                     for(int j=0; j<5; j++) {
                         chain.residues[i+j].ss = Tmdet::Types::SecStructType::I;
@@ -267,18 +342,18 @@ namespace Tmdet::Utils {
     void Dssp::detectSecStructT(Tmdet::VOs::Chain& chain) {
         for(int i=4; i<chain.length; i++) {
             if (chain.residues[i].ss == Tmdet::Types::SecStructType::U &&
-                (checkIfTurn(chain,i,3,"t3") ||
-                checkIfTurn(chain,i,4,"t4") ||
-                checkIfTurn(chain,i,5,"t5"))) {
+                (checkIfTurn(i,3) ||
+                checkIfTurn(i,4) ||
+                checkIfTurn(i,5))) {
                     chain.residues[i].ss = Tmdet::Types::SecStructType::T;
                 }
         }
     }
 
-    bool Dssp::checkIfTurn(Tmdet::VOs::Chain& chain,int pos, int r, string key) {
+    bool Dssp::checkIfTurn(int pos, int r) {
         for(int i =1; i<r; i++) {
-            if (any_cast<char>(chain.residues[pos-i].temp[key]) == '>' || 
-                any_cast<char>(chain.residues[pos-i].temp[key]) == 'x') {
+            if (states[pos-i].turn(r) == '>' || 
+                states[pos-i].turn(r) == 'x') {
                     return true;
                 }
         }
@@ -326,18 +401,18 @@ namespace Tmdet::Utils {
     void Dssp::detectSecStructBE(Tmdet::VOs::Chain& chain) {
         for(int i=1; i<chain.length-1; i++) {
             if (chain.orderDistance(i-1,i) == 1 && chain.orderDistance(i,i+1) == 1) {
-                if (any_cast<int>(chain.residues[i].temp["pb"]) >= 0) {
-                    if (any_cast<int>(chain.residues[i-1].temp["pb"]) >=0 || 
-                        any_cast<int>(chain.residues[i+1].temp["pb"]) >= 0) {
+                if (states[i].pb >= 0) {
+                    if (states[i-1].pb >=0 || 
+                        states[i+1].pb >= 0) {
                         chain.residues[i].ss = Tmdet::Types::SecStructType::E;
                     }
                     else {
                         chain.residues[i].ss = Tmdet::Types::SecStructType::B;
                     }
                 }
-                if (any_cast<int>(chain.residues[i].temp["apb"]) > 0) {
-                    if (any_cast<int>(chain.residues[i-1].temp["apb"]) >= 0 || 
-                        any_cast<int>(chain.residues[i+1].temp["apb"]) >= 0) {
+                if (states[i].apb > 0) {
+                    if (states[i-1].apb >= 0 || 
+                        states[i+1].apb >= 0) {
                         chain.residues[i].ss = Tmdet::Types::SecStructType::E;
                     }
                     else {
@@ -1,49 +1,112 @@
-// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
-//             Protein Bioinformatics Research Group 
-//             Research Center of Natural Sciences, HUN-REN
-//
-// License:    CC-BY-NC-4.0, see LICENSE.txt
-
+// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
+//             Protein Bioinformatics Research Group 
+//             Research Center of Natural Sciences, HUN-REN
+//
+// License:    CC-BY-NC-4.0, see LICENSE.txt
+
 #pragma once
 
 #include <string>
+#include <vector>
+#include <array>
 #include <gemmi/model.hpp>
+#include <VOs/HBond.hpp>
 #include <VOs/Protein.hpp>
+#include <Utils/CellList.hpp>
 
 namespace Tmdet::Utils {
 
+    /**
+     * @brief working state of dssp calculation for one residue
+     */
+    struct dsspState {
+        /**
+         * @brief the two best hydrogen bonds of the residue
+         */
+        Tmdet::VOs::HBond hbond1;
+        Tmdet::VOs::HBond hbond2;
+
+        /**
+         * @brief 3, 4 and 5 turn codes (' ', '>', '<', 'x' or '*')
+         */
+        std::array<char,3> turns = {' ',' ',' '};
+
+        /**
+         * @brief index of parallel and antiparallel bridge partner (-1: none)
+         */
+        int pb = -1;
+        int apb = -1;
+
+        char& turn(int d) {
+            return turns[d-3];
+        }
+    };
+
     class Dssp {
         private:
             Tmdet::VOs::Protein& protein;
+            int numThreads = 1;
+
+            /**
+             * @brief CA atoms of the chain in cells for acceptor search,
+             *        caResidues holds the residue index of each CA
+             */
+            bool useGrid = true;
+            CellList caList;
+            std::vector<int> caResidues;
+            std::vector<int> ids;
+
+            /**
+             * @brief working state of the residues of the actual chain
+             */
+            std::vector<dsspState> states;
+
+            void initStates(Tmdet::VOs::Chain& chain);
             void calcDsspOnChain(Tmdet::VOs::Chain& chain);
-            void writeDsspOnChain(Tmdet::VOs::Chain& chain);
             void createHydrogenBonds(Tmdet::VOs::Chain& chain);
+            void setCaList(Tmdet::VOs::Chain& chain);
             void scanNeighbors(Tmdet::VOs::Chain& chain, int r1, const gemmi::Atom* CA, const gemmi::Atom* N, gemmi::Position hcoord);
-            void setHydrogenBond(Tmdet::VOs::Residue& donor, Tmdet::VOs::Residue& akceptor, double energy);
-            void detectTurns(Tmdet::VOs::Chain& chain, int d, std::string key);
-            bool checkHbond1(Tmdet::VOs::Chain& chain, Tmdet::VOs::Residue& res, int d);
-            bool checkHbond2(Tmdet::VOs::Chain& chain, Tmdet::VOs::Residue& res, int d);
+            void scanNeighborsReference(Tmdet::VOs::Chain& chain, int r1, const gemmi::Atom* CA, const gemmi::Atom* N, gemmi::Position hcoord);
+            void checkHydrogenBond(Tmdet::VOs::Chain& chain, int r1, int r2, const gemmi::Atom* CA, const gemmi::Atom* N, const gemmi::Position& hcoord);
+            void setHydrogenBond(int donor, Tmdet::VOs::Residue& akceptor, double energy);
+            void detectTurns(Tmdet::VOs::Chain& chain, int d);
+            bool checkHbond1(Tmdet::VOs::Chain& chain, int i, int d);
+            bool checkHbond2(Tmdet::VOs::Chain& chain, int i, int d);
             void initPbs(Tmdet::VOs::Chain& chain);
-            void detectSecStructH(Tmdet::VOs::Chain& chain,std::string key);
-            void detectSecStructG(Tmdet::VOs::Chain& chain,std::string key);
-            void detectSecStructI(Tmdet::VOs::Chain& chain,std::string key);
+            void detectSecStructH(Tmdet::VOs::Chain& chain);
+            void detectSecStructG(Tmdet::VOs::Chain& chain);
+            void detectSecStructI(Tmdet::VOs::Chain& chain);
             void detectSecStructT(Tmdet::VOs::Chain& chain);
             void detectSecStructS(Tmdet::VOs::Chain& chain);
             void detectSecStructBE(Tmdet::VOs::Chain& chain);
             bool checkPb(Tmdet::VOs::Chain& chain, int i, int j);
             bool checkApb(Tmdet::VOs::Chain& chain, int i, int j);
             bool checkIfAreOther(Tmdet::VOs::Chain& chain, Tmdet::Types::SecStruct ss,int i, int d);
-            bool checkIfTurn(Tmdet::VOs::Chain& chain,int pos, int r, std::string key);
+            bool checkIfTurn(int pos, int r);
             void exec();
-            void init();
-            void end();
+
+            /**
+             * @brief worker of one chain (working state is not shared
+             *        between threads), it does not run the calculation
+             */
+            Dssp(Tmdet::VOs::Protein& protein, bool useGrid) :
+                protein(protein),
+                useGrid(useGrid) {
+            }
 
         public:
-            explicit Dssp(Tmdet::VOs::Protein& protein) : 
-                protein(protein) {
+            explicit Dssp(Tmdet::VOs::Protein& protein, int numThreads = 1) : 
+                protein(protein),
+                numThreads(numThreads) {
                     exec();
             } ;
             ~Dssp()=default;
 
+            /**
+             * @brief Compare the speed and the result of the all pairs and
+             *        the grid based hydrogen bond search on the selected chains
+             */
+            void benchmark();
+
     };
 }
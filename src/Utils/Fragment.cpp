@@ -42,6 +42,7 @@ namespace Tmdet::Utils {
     void Fragment::setContactMap() {
         nr = protein.numberOfSelectedResidues();
         int cm_index=0;
+        cellList.build(protein,9);
 
         protein.eachSelectedResidue(
             [&](Tmdet::VOs::Residue& residue) -> void {
@@ -71,12 +72,11 @@ namespace Tmdet::Utils {
         const gemmi::Atom* ca_atom = residue.gemmi.get_ca();
         bool check=false;
         if (ca_atom) {
-            for (auto mark: protein.neighbors.find_neighbors(*ca_atom, 3, 9)) {
-                if (protein.chains[mark->chain_idx].selected
-                    && protein.chains[mark->chain_idx].residues[mark->residue_idx].selected
-                    && protein.chains[mark->chain_idx].residues[mark->residue_idx].atoms[mark->atom_idx].gemmi.name == "CA") {
-                    ret.emplace_back(mark->chain_idx,mark->residue_idx);
-                    check |= (std::abs(residue.idx - protein.chains[mark->chain_idx].residues[mark->residue_idx].idx) > 3);
+            cellList.find(*ca_atom, 3, 9, ids);
+            for (auto id: ids) {
+                if (cellList.atom(id).gemmi.name == "CA") {
+                    ret.emplace_back(cellList.chainIdx(id),cellList.residueIdx(id));
+                    check |= (std::abs(residue.idx - cellList.residue(id).idx) > 3);
                 }
             }
         }
@@ -10,6 +10,7 @@
 #include <VOs/Protein.hpp>
 #include <VOs/Chain.hpp>
 #include <VOs/Residue.hpp>
+#include <Utils/CellList.hpp>
 
 
 namespace Tmdet::Utils {
@@ -25,6 +26,8 @@ namespace Tmdet::Utils {
             int numFragments;
             int nr;
             std::vector<std::vector<bool>> contactMap;
+            CellList cellList;
+            std::vector<int> ids;
             
             std::vector<_cr> getNeighbors(const Tmdet::VOs::Residue& residue);
             void setContactMap();
@@ -15,20 +15,30 @@ namespace Tmdet::Utils {
     class MyDssp {
         private:
             Tmdet::VOs::Protein& protein;
+            int numThreads;
             void exec();
-            void end();
-            void setCO();
-            void setAngle();
-            void setHelix();
-            void setExtended();
-            void removeMins(std::string what);
+            static void end(Tmdet::VOs::Chain& chain);
+            static void setCO(Tmdet::VOs::Chain& chain);
+            void setAngle(Tmdet::VOs::Chain& chain);
+            void setHelix(Tmdet::VOs::Chain& chain);
+            void setExtended(Tmdet::VOs::Chain& chain);
+            void removeMins(Tmdet::VOs::Chain& chain, std::string what);
 
         public:
-            explicit MyDssp(Tmdet::VOs::Protein& protein) : 
-                protein(protein) {
+            explicit MyDssp(Tmdet::VOs::Protein& protein, int numThreads = 1) : 
+                protein(protein),
+                numThreads(numThreads) {
                     exec();
             } ;
             ~MyDssp()=default;
 
+            /**
+             * @brief Set only the CA and C-O vectors of the residues used by
+             *        later steps (if secondary structure comes from cache)
+             *
+             * @param protein
+             */
+            static void setCoordinates(Tmdet::VOs::Protein& protein);
+
     };
 }
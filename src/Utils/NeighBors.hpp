@@ -10,6 +10,7 @@
 #include <VOs/CR.hpp>
 #include <VOs/Protein.hpp>
 #include <VOs/Residue.hpp>
+#include <Utils/CellList.hpp>
 
 /**
  * @brief namespace for utils
@@ -21,25 +22,40 @@ namespace Tmdet::Utils {
      */
     struct NeighBors {
         static void store(Tmdet::VOs::Protein& protein) {
+            //Ca positions are queried in one batch
+            auto cellList = CellList(protein, 6.5);
+            std::vector<gemmi::Position> positions;
+            std::vector<char> altlocs;
+            std::vector<Tmdet::VOs::Residue*> residues;
             protein.eachSelectedResidue(
                 [&](Tmdet::VOs::Residue& residue) -> void {
-                    std::vector<Tmdet::VOs::CR> neighbors;
-                    auto ca =residue.getCa();
-                    if (ca != nullptr) {
-                        for(auto m : protein.neighbors.find_neighbors(*ca, 2, 6.5)) {
-                            if (protein.chains[m->chain_idx].selected
-                                && protein.chains[m->chain_idx].residues[m->residue_idx].selected
-                                && protein.chains[m->chain_idx].residues[m->residue_idx].atoms[m->atom_idx].gemmi.name == "CA"
-                                && (residue.chainIdx != m->chain_idx || 
-                                    (residue.chainIdx == m->chain_idx 
-                                        && std::abs(residue.labelId - protein.chains[m->chain_idx].residues[m->residue_idx].labelId) > 2))) {
-                                neighbors.emplace_back(m->chain_idx,m->residue_idx);
-                            }
-                        }
+                    if (auto ca = residue.getCa(); ca != nullptr) {
+                        positions.push_back(ca->pos);
+                        altlocs.push_back(ca->altloc);
+                        residues.push_back(&residue);
+                    }
+                    else {
+                        residue.temp.try_emplace("ca_neighbors",std::vector<Tmdet::VOs::CR>());
                     }
-                    residue.temp.try_emplace("ca_neighbors",neighbors);
                 }
             );
+            std::vector<unsigned int> offsets;
+            std::vector<int> ids;
+            cellList.find(positions, altlocs, 2, 6.5, offsets, ids);
+            for (unsigned long int i=0; i<residues.size(); i++) {
+                auto& residue = *residues[i];
+                std::vector<Tmdet::VOs::CR> neighbors;
+                for (unsigned int k=offsets[i]; k<offsets[i+1]; k++) {
+                    int id = ids[k];
+                    if (cellList.atom(id).gemmi.name == "CA"
+                        && (residue.chainIdx != cellList.chainIdx(id) || 
+                            (residue.chainIdx == cellList.chainIdx(id) 
+                                && std::abs(residue.labelId - cellList.residue(id).labelId) > 2))) {
+                        neighbors.emplace_back(cellList.chainIdx(id),cellList.residueIdx(id));
+                    }
+                }
+                residue.temp.try_emplace("ca_neighbors",neighbors);
+            }
         }
 
         static std::vector<Tmdet::VOs::CR> get(Tmdet::VOs::Residue& residue) {
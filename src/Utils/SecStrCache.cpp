@@ -0,0 +1,145 @@
+// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
+//             Protein Bioinformatics Research Group 
+//             Research Center of Natural Sciences, HUN-REN
+//
+// License:    CC-BY-NC-4.0, see LICENSE.txt
+
+#include <format>
+#include <cstring>
+#include <gemmi/model.hpp>
+#include <Config.hpp>
+#include <System/Logger.hpp>
+#include <System/FilePaths.hpp>
+#include <Types/SecStruct.hpp>
+#include <VOs/Protein.hpp>
+#include <Utils/CacheFile.hpp>
+#include <Utils/Md5.hpp>
+#include <Utils/SecStrCache.hpp>
+
+namespace Tmdet::Utils {
+
+    std::string secStrCache::path() const {
+        return Tmdet::System::FilePaths::cache(key) + "/" + key + ".ss";
+    }
+
+    uint32_t secStrCache::count(const Tmdet::VOs::Protein& protein) {
+        uint32_t n = 0;
+        for(const auto& c : protein.chains) {
+            n += c.residues.size();
+        }
+        return n;
+    }
+
+    std::string secStrCache::digest(const Tmdet::VOs::Protein& protein) {
+        std::string raw = std::format("ss|{}", VERSION);
+        for(const auto& c : protein.chains) {
+            raw += std::format("|{}|{}|{}", c.id, c.selected, c.type.name);
+            for (const auto& r : c.residues) {
+                raw += std::format("|{}{}{}", r.gemmi.name, r.labelId, r.selected);
+                for(const auto& a : r.gemmi.atoms) {
+                    if (a.name == "N" || a.name == "CA" || a.name == "C" || a.name == "O") {
+                        raw += a.name;
+                        raw += a.altloc;
+                        raw.append(reinterpret_cast<const char*>(&a.pos.x), sizeof(double));
+                        raw.append(reinterpret_cast<const char*>(&a.pos.y), sizeof(double));
+                        raw.append(reinterpret_cast<const char*>(&a.pos.z), sizeof(double));
+                    }
+                }
+            }
+        }
+        return Tmdet::Utils::Md5::getHash(raw);
+    }
+
+    bool secStrCache::proteinFromCache(Tmdet::VOs::Protein& protein, const secStrCacheVector* vectors,
+        uint32_t numVectors, const char* codes) const {
+        unsigned long int index = 0;
+        for(auto& c : protein.chains) {
+            for (auto& r : c.residues) {
+                if (!Tmdet::Types::SecStructs.contains(codes[index])) {
+                    return false;
+                }
+                r.ss = Tmdet::Types::SecStructs.at(codes[index++]);
+                r.secStrVecIdx = -1;
+            }
+        }
+        protein.secStrVecs.clear();
+        for (uint32_t i=0; i<numVectors; i++) {
+            const auto& v = vectors[i];
+            if (!Tmdet::Types::SecStructs.contains(v.type)
+                || v.chainIdx < 0 || v.chainIdx >= (int)protein.chains.size()
+                || v.begResIdx < 0 || v.endResIdx >= (int)protein.chains[v.chainIdx].residues.size()) {
+                protein.secStrVecs.clear();
+                return false;
+            }
+            protein.secStrVecs.push_back(Tmdet::VOs::SecStrVec({
+                Tmdet::Types::SecStructs.at(v.type),
+                gemmi::Vec3(v.begin[0],v.begin[1],v.begin[2]),
+                gemmi::Vec3(v.end[0],v.end[1],v.end[2]),
+                v.chainIdx, v.begResIdx, v.endResIdx
+            }));
+            for (int j=v.begResIdx; j<=v.endResIdx; j++) {
+                protein.chains[v.chainIdx].residues[j].secStrVecIdx = (int)i;
+            }
+        }
+        return true;
+    }
+
+    bool secStrCache::read(Tmdet::VOs::Protein& protein) const {
+        return cacheFile::read(path(),"secondary structure",sizeof(secStrCacheHeader),
+            [&](const char* map, size_t size) -> bool {
+                auto header = reinterpret_cast<const secStrCacheHeader*>(map);
+                auto data = map + sizeof(secStrCacheHeader);
+                size_t dataSize = (size_t)header->numVectors * sizeof(secStrCacheVector) + header->numResidues;
+                bool valid = (std::memcmp(header->magic,MAGIC,sizeof(MAGIC)) == 0
+                    && header->version == VERSION
+                    && std::string(header->key,sizeof(header->key)) == key
+                    && header->numResidues == count(protein)
+                    && size == sizeof(secStrCacheHeader) + dataSize
+                    && header->checksum == cacheFile::checksum(data,dataSize));
+                if (valid) {
+                    auto vectors = reinterpret_cast<const secStrCacheVector*>(data);
+                    auto codes = data + (size_t)header->numVectors * sizeof(secStrCacheVector);
+                    valid = proteinFromCache(protein,vectors,header->numVectors,codes);
+                }
+                return valid;
+            }
+        );
+    }
+
+    void secStrCache::write(const Tmdet::VOs::Protein& protein) const {
+        std::vector<secStrCacheVector> vectors;
+        for (const auto& v: protein.secStrVecs) {
+            secStrCacheVector record;
+            std::memset(&record, 0, sizeof(record));
+            record.begin[0] = v.begin.x;
+            record.begin[1] = v.begin.y;
+            record.begin[2] = v.begin.z;
+            record.end[0] = v.end.x;
+            record.end[1] = v.end.y;
+            record.end[2] = v.end.z;
+            record.chainIdx = v.chainIdx;
+            record.begResIdx = v.begResIdx;
+            record.endResIdx = v.endResIdx;
+            record.type = v.type.code;
+            vectors.push_back(record);
+        }
+        std::string codes;
+        codes.reserve(count(protein));
+        for(const auto& c : protein.chains) {
+            for (const auto& r : c.residues) {
+                codes += r.ss.code;
+            }
+        }
+        std::string data(reinterpret_cast<const char*>(vectors.data()), vectors.size() * sizeof(secStrCacheVector));
+        data += codes;
+        secStrCacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.numResidues = codes.size();
+        header.numVectors = vectors.size();
+        header.checksum = cacheFile::checksum(data.data(),data.size());
+        std::memcpy(header.key, key.data(), std::min(key.size(),sizeof(header.key)));
+        cacheFile::write(path(),"secondary structure",&header,sizeof(header),data.data(),data.size());
+    }
+}
@@ -0,0 +1,126 @@
+// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
+//             Protein Bioinformatics Research Group 
+//             Research Center of Natural Sciences, HUN-REN
+//
+// License:    CC-BY-NC-4.0, see LICENSE.txt
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <VOs/Protein.hpp>
+
+/**
+ * @brief namespace for tmdet utils
+ */
+namespace Tmdet::Utils {
+
+    /**
+     * @brief header of the binary secondary structure cache file, it is
+     *        followed by numVectors secStrCacheVector records and
+     *        numResidues secondary structure codes
+     */
+    struct secStrCacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t numResidues;
+        uint32_t numVectors;
+        uint32_t reserved;
+        uint64_t checksum;
+        char key[32];
+    };
+
+    /**
+     * @brief secondary structure vector record of the cache file
+     */
+    struct secStrCacheVector {
+        double begin[3];
+        double end[3];
+        int32_t chainIdx;
+        int32_t begResIdx;
+        int32_t endResIdx;
+        char type;
+        char reserved[3];
+    };
+
+    /**
+     * @brief secondary structure (residue codes and secondary structure
+     *        vectors) stored in a versioned, checksummed binary file keyed by
+     *        the digest of the backbone coordinates
+     */
+    class secStrCache {
+        private:
+            /**
+             * @brief digest of the backbone coordinates
+             */
+            std::string key;
+
+            /**
+             * @brief path of the cache file
+             */
+            std::string path() const;
+
+            /**
+             * @brief Number of residues stored for the protein
+             *
+             * @param protein
+             * @return uint32_t
+             */
+            static uint32_t count(const Tmdet::VOs::Protein& protein);
+
+            /**
+             * @brief Set secondary structure of residues and secondary
+             *        structure vectors from cache data
+             *
+             * @param protein
+             * @param vectors
+             * @param numVectors
+             * @param codes
+             * @return bool false if cache data is inconsistent with the protein
+             */
+            bool proteinFromCache(Tmdet::VOs::Protein& protein, const secStrCacheVector* vectors,
+                uint32_t numVectors, const char* codes) const;
+
+        public:
+            /**
+             * @brief magic number and version of the cache file format
+             */
+            static constexpr char MAGIC[8] = {'T','M','D','S','S','E','C','\0'};
+            static constexpr uint32_t VERSION = 1;
+
+            /**
+             * @brief Construct a new secondary structure cache object
+             *
+             * @param protein
+             */
+            explicit secStrCache(const Tmdet::VOs::Protein& protein) : key(digest(protein)) {}
+
+            /**
+             * @brief Digest of everything the secondary structure definition
+             *        depends on: chain and residue selection, residue names and
+             *        numbering, and backbone (N, CA, C, O) coordinates
+             *
+             * @param protein
+             * @return std::string
+             */
+            static std::string digest(const Tmdet::VOs::Protein& protein);
+
+            /**
+            * @brief Read cache file by mmap, validate it and set secondary
+            *        structure of residues and protein.secStrVecs
+            *
+            * @param protein
+            * @return bool false if the file is missing or invalid
+            */
+            bool read(Tmdet::VOs::Protein& protein) const;
+
+            /**
+            * @brief Write secondary structure of the protein to file,
+            *        using temporary file and rename for atomic update
+            *
+            * @param protein
+            */
+            void write(const Tmdet::VOs::Protein& protein) const;
+    };
+}
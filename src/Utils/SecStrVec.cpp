@@ -30,15 +30,23 @@ namespace Tmdet::Utils {
     
     void SecStrVec::define() {
         protein.secStrVecs.clear();
-        for(auto& chain: protein.chains) {
-            int begin = 0;
-            int end = 0;
-            while(getNextRegion(chain, begin, end)) {
-                if (end - begin > 3) {
-                    protein.secStrVecs.push_back(getVector(chain, begin, end - 1));
+        //vectors are collected for each chain in parallel and merged in
+        //chain order, so the result does not depend on the number of threads
+        std::vector<std::vector<Tmdet::VOs::SecStrVec>> chainVectors(protein.chains.size());
+        protein.eachChainInParallel(numThreads, false,
+            [&](Tmdet::VOs::Chain& chain) -> void {
+                int begin = 0;
+                int end = 0;
+                while(getNextRegion(chain, begin, end)) {
+                    if (end - begin > 3) {
+                        chainVectors[chain.idx].push_back(getVector(chain, begin, end - 1));
+                    }
+                    begin = end;
                 }
-                begin = end;
             }
+        );
+        for(const auto& vectors: chainVectors) {
+            protein.secStrVecs.insert(protein.secStrVecs.end(), vectors.begin(), vectors.end());
         }
         checkVectorsForSplitting();
         if (protein.secStrVecs.size()>1) {
@@ -20,6 +20,7 @@ namespace Tmdet::Utils {
     class SecStrVec {
         private:
             Tmdet::VOs::Protein& protein;
+            int numThreads;
 
             void define();            
             bool getNextRegion(Tmdet::VOs::Chain& chain, int& begin, int& end) const;
@@ -39,8 +40,9 @@ namespace Tmdet::Utils {
             Tmdet::VOs::SecStrVec mergeVectors(const Tmdet::VOs::SecStrVec& v1, const Tmdet::VOs::SecStrVec& v2) const;
 
         public:
-            explicit SecStrVec(Tmdet::VOs::Protein& protein) :
-                protein(protein) {
+            explicit SecStrVec(Tmdet::VOs::Protein& protein, int numThreads = 1) :
+                protein(protein),
+                numThreads(numThreads) {
                     define();
             }
             ~SecStrVec()=default;
@@ -11,6 +11,11 @@
 #include <numeric>
 #include <filesystem>
 #include <format>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <bit>
+#include <cstring>
 #include <gemmi/model.hpp>
 #include <gemmi/neighbor.hpp>
 #include <Config.hpp>
@@ -18,6 +23,10 @@
 #include <System/FilePaths.hpp>
 #include <Types/Residue.hpp>
 #include <VOs/Protein.hpp>
+#include <eigen3/Eigen/Dense>
+#include <Utils/CacheFile.hpp>
+#include <Utils/Md5.hpp>
+#include <Utils/Oligomer.hpp>
 #include <Utils/Surface.hpp>
 
 using namespace std;
@@ -25,84 +34,163 @@ namespace StructVO = Tmdet::VOs;
 
 namespace Tmdet::Utils {
 
-    void surfaceCache::proteinFromCache(Tmdet::VOs::Protein& protein) {
-        unsigned int i =0;
-        for(auto& c : protein.chains) {
+    std::string surfaceCache::path() const {
+        return Tmdet::System::FilePaths::cache(key) + "/" + key + ".surf";
+    }
+
+    uint32_t surfaceCache::count(const Tmdet::VOs::Protein& protein) {
+        uint32_t n = 0;
+        for(const auto& c : protein.chains) {
             if (c.selected) {
-                chainFromCache(c,i);
+                for (const auto& r : c.residues) {
+                    n += (r.selected ? 2 * r.atoms.size() : 0);
+                }
             }
         }
+        return n;
     }
 
-    void surfaceCache::chainFromCache(Tmdet::VOs::Chain& chain, unsigned int& index) {
-        for (auto& r : chain.residues) {
-            r.surface = 0.0;
-            r.outSurface = 0.0;
-            for(auto& a : r.atoms) {
-                a.surface = cache[index];
-                r.surface += a.surface;
-                index++;
-                a.outSurface = cache[index];
-                r.outSurface += a.outSurface;
-                index++;
+    void surfaceCache::proteinFromCache(Tmdet::VOs::Protein& protein, const float* data) const {
+        unsigned int index = 0;
+        for(auto& c : protein.chains) {
+            if (!c.selected) {
+                continue;
+            }
+            for (auto& r : c.residues) {
+                if (!r.selected) {
+                    continue;
+                }
+                r.surface = 0.0;
+                r.outSurface = 0.0;
+                for(auto& a : r.atoms) {
+                    a.surface = data[index++];
+                    r.surface += a.surface;
+                    a.outSurface = data[index++];
+                    r.outSurface += a.outSurface;
+                }
             }
         }
     }
 
-    void surfaceCache::proteinToCache(const Tmdet::VOs::Protein& protein) {
-        cache.clear();
-        for( const auto& c : protein.chains) {
-            if (c.selected) {
-                chainToCache(c);
+    std::vector<float> surfaceCache::proteinToCache(const Tmdet::VOs::Protein& protein) const {
+        std::vector<float> data;
+        data.reserve(count(protein));
+        for(const auto& c : protein.chains) {
+            if (!c.selected) {
+                continue;
+            }
+            for (const auto& r : c.residues) {
+                if (!r.selected) {
+                    continue;
+                }
+                for(const auto& a : r.atoms) {
+                    data.push_back((float)a.surface);
+                    data.push_back((float)a.outSurface);
+                }
             }
         }
+        return data;
     }
 
-    void surfaceCache::chainToCache(const Tmdet::VOs::Chain& chain) {
-        for (const auto& r : chain.residues) {
-            for(const auto& a : r.atoms) {
-                cache.push_back(a.surface);
-                cache.push_back(a.outSurface);
+    bool surfaceCache::read(Tmdet::VOs::Protein& protein) const {
+        return cacheFile::read(path(),"surface",sizeof(surfaceCacheHeader),
+            [&](const char* map, size_t size) -> bool {
+                auto header = reinterpret_cast<const surfaceCacheHeader*>(map);
+                auto data = map + sizeof(surfaceCacheHeader);
+                size_t dataSize = (size_t)header->count * sizeof(float);
+                bool valid = (std::memcmp(header->magic,MAGIC,sizeof(MAGIC)) == 0
+                    && header->version == VERSION
+                    && std::string(header->key,sizeof(header->key)) == key
+                    && header->count == count(protein)
+                    && size == sizeof(surfaceCacheHeader) + dataSize
+                    && header->checksum == cacheFile::checksum(data,dataSize));
+                if (valid) {
+                    proteinFromCache(protein,reinterpret_cast<const float*>(data));
+                }
+                return valid;
             }
-        }
+        );
     }
 
-    bool surfaceCache::read(Tmdet::VOs::Protein& protein) {
-        std::string hash = protein.hash();
-        std::string dir = Tmdet::System::FilePaths::cache(hash);
-        std::string path = dir + "/" + hash + "_" + protein.code + ".bin";
-        std::ifstream file(path, ios::binary);
-        if (!file.is_open()) {
-            return false;
-        }
-        auto size = cache.size();
-        file.read(reinterpret_cast<char*>(&size), sizeof(size));
-        cache.resize(size);
-        file.read(reinterpret_cast<char*>(cache.data()), size * sizeof(double));
-        file.close();
-        proteinFromCache(protein);
-        return true;
+    void surfaceCache::write(const Tmdet::VOs::Protein& protein) const {
+        auto data = proteinToCache(protein);
+        surfaceCacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.count = data.size();
+        header.checksum = cacheFile::checksum(reinterpret_cast<const char*>(data.data()),data.size() * sizeof(float));
+        std::memcpy(header.key, key.data(), std::min(key.size(),sizeof(header.key)));
+        cacheFile::write(path(),"surface",&header,sizeof(header),data.data(),data.size() * sizeof(float));
     }
 
-    void surfaceCache::write(const Tmdet::VOs::Protein& protein) {
-        proteinToCache(protein);
-        std::string hash = protein.hash();
-        std::string dir = Tmdet::System::FilePaths::cache(hash);
-        std::filesystem::create_directories(dir);
-        std::string path = dir + "/" + hash + "_" + protein.code + ".bin";
-        std::ofstream file(path, ios::binary);
-        if (!file.is_open()) {
-            logger.warn("Could not write surface cache. Path: {}",path);
-            return;
+    std::string Surface::cacheKey() const {
+        std::string raw = std::format("{}|{}|{}|{}|{}|{}|{}",
+            protein.code, engine,
+            environment.get("TMDET_SURF_PROBSIZE",DEFAULT_TMDET_SURF_PROBSIZE),
+            environment.get("TMDET_SURF_ZSLICE",DEFAULT_TMDET_SURF_ZSLICE),
+            (engine=="SR"?environment.get("TMDET_SURF_POINTS",DEFAULT_TMDET_SURF_POINTS):""),
+            outside,
+            (outside?environment.get("TMDET_SURF_GRID",DEFAULT_TMDET_SURF_GRID):""));
+        if (sizeof(Tmdet::real) == sizeof(float)) {
+            raw += "|f32";
+        }
+        if (symmetric) {
+            raw += std::format("|sym|{}|{}|{}",
+                environment.get("TMDET_SURF_SYM_RMSD",DEFAULT_TMDET_SURF_SYM_RMSD),
+                environment.get("TMDET_SURF_SYM_SAMPLE",DEFAULT_TMDET_SURF_SYM_SAMPLE),
+                environment.get("TMDET_SURF_SYM_TOL",DEFAULT_TMDET_SURF_SYM_TOL));
         }
-        auto size = cache.size();
-        file.write(reinterpret_cast<const char*>(&size), sizeof(size));
-        file.write(reinterpret_cast<const char*>(cache.data()), size * sizeof(double));
-        file.close();
+        for(const auto& c : protein.chains) {
+            if (!c.selected) {
+                continue;
+            }
+            raw += "|" + c.id;
+            for (const auto& r : c.residues) {
+                //the surface depends on the residue selection (e.g. fragments)
+                if (!r.selected) {
+                    continue;
+                }
+                raw += r.gemmi.name;
+                for(const auto& a : r.atoms) {
+                    raw += a.gemmi.name;
+                    raw.append(reinterpret_cast<const char*>(&a.gemmi.pos.x), sizeof(double));
+                    raw.append(reinterpret_cast<const char*>(&a.gemmi.pos.y), sizeof(double));
+                    raw.append(reinterpret_cast<const char*>(&a.gemmi.pos.z), sizeof(double));
+                }
+            }
+        }
+        return Tmdet::Utils::Md5::getHash(raw);
     }
     
     void Surface::run() {
-        surfaceCache cache;
+        if (engine.empty()) {
+            engine = environment.get("TMDET_SURF_ENGINE",DEFAULT_TMDET_SURF_ENGINE);
+        }
+        if (engine != "LR" && engine != "SR") {
+            logger.warn("Unknown surface engine: {}, using LR",engine);
+            engine = "LR";
+        }
+        initSpherePoints();
+        if (benchmark) {
+            initTempData();
+            benchmarkArcKernel();
+            compareEngines();
+        }
+        if (contacts != nullptr) {
+            //surfaces derived from the stored contacts (-fc) are not cached
+            initTempData();
+            if (!contacts->built) {
+                setContacts();
+                buildContacts();
+            }
+            else if (!setContactsFromStore()) {
+                setContacts();
+            }
+            setOutsideSurface();
+            return;
+        }
+        surfaceCache cache(cacheKey());
         if (noCache || !cache.read(protein) ) {
             initTempData();
             setContacts();
@@ -113,110 +201,583 @@ namespace Tmdet::Utils {
 
     void Surface::initTempData() {
         const double probSize = std::stof(environment.get("TMDET_SURF_PROBSIZE",DEFAULT_TMDET_SURF_PROBSIZE));
+        zSlice = std::stof(environment.get("TMDET_SURF_ZSLICE",DEFAULT_TMDET_SURF_ZSLICE));
+        cellList.build(protein,7.0);
+        radius.assign(cellList.size(),0.0);
+        //residue types are looked up once for each residue name
+        std::unordered_map<std::string,Tmdet::Types::Residue> residueTypes;
         protein.eachSelectedResidue(
             [&](Tmdet::VOs::Residue& residue) -> void {
+                auto it = residueTypes.find(residue.gemmi.name);
+                if (it == residueTypes.end()) {
+                    it = residueTypes.emplace(residue.gemmi.name,Tmdet::Types::ResidueType::getResidue(residue.gemmi.name)).first;
+                }
+                const auto& residueType = it->second;
                 for(auto& atom: residue.atoms) {
-                    Tmdet::Types::Residue residueType = Tmdet::Types::ResidueType::getResidue(residue.gemmi.name);
                     double vdw = probSize;
-                    if (residueType.atoms.contains(atom.gemmi.name)) {
-                        vdw += residueType.atoms.at(atom.gemmi.name).atom.vdw;
+                    if (auto at = residueType.atoms.find(atom.gemmi.name); at != residueType.atoms.end()) {
+                        vdw += at->second.atom.vdw;
                     } else {
                         vdw += Types::AtomType::DEFAULT_VDW;
                     }
-                    atom.temp.insert({"vdw",any_cast<double>(vdw)});
+                    radius[cellList.id(atom)] = vdw;
                 }
             }
         );
     }
 
     void Surface::setContacts() {
+        std::vector<symmetryMate> mates;
+        std::vector<bool> isMate(protein.chains.size(),false);
+        if (symmetric) {
+            mates = getSymmetryMates();
+            for (const auto& mate: mates) {
+                isMate[mate.chainIdx] = true;
+            }
+        }
+        std::vector<Tmdet::VOs::Atom*> atoms;
+        protein.eachSelectedResidue(
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                if (!isMate[residue.chainIdx]) {
+                    for(auto& atom: residue.atoms) {
+                        atoms.push_back(&atom);
+                    }
+                }
+            }
+        );
+        calcSurfaceOfAtoms(atoms);
+        for (const auto& mate: mates) {
+            if (!copySurface(mate)) {
+                atoms.clear();
+                for (const auto& pair: mate.atoms) {
+                    atoms.push_back(pair.second);
+                }
+                calcSurfaceOfAtoms(atoms);
+            }
+        }
+        //residue sums in fixed order, so the result does not depend on threads
         protein.eachSelectedResidue(
             [&](Tmdet::VOs::Residue& residue) -> void {
                 residue.surface = 0.0;
                 for(auto& atom: residue.atoms) {
-                    setContactsOfAtom(atom);
                     residue.surface += atom.surface;
                 }
-                //residue.outSurface = residue.surface;
             }
         );
     }
 
-    void Surface::setContactsOfAtom(Tmdet::VOs::Atom& a_atom) {
+    void Surface::calcSurfaceOfAtoms(const std::vector<Tmdet::VOs::Atom*>& atoms) {
+        if (numThreads < 1) {
+            numThreads = (int)std::thread::hardware_concurrency();
+        }
+        if (numThreads > 1) {
+            setContactsInParallel(atoms);
+        }
+        else {
+            surfTemp st;
+            for(auto atom: atoms) {
+                setContactsOfAtom(*atom,st);
+            }
+        }
+    }
+
+    std::vector<symmetryMate> Surface::getSymmetryMates() const {
+        const double maxRmsd = std::stof(environment.get("TMDET_SURF_SYM_RMSD",DEFAULT_TMDET_SURF_SYM_RMSD));
+        std::vector<symmetryMate> mates;
+        for (const auto& entity: Tmdet::Utils::Oligomer::getHomoOligomerEntities(protein.gemmi)) {
+            int refChainIdx = -1;
+            for (const auto& chainId: entity.subchains) {
+                int chainIdx = -1;
+                for (const auto& chain: protein.chains) {
+                    if (chain.selected && chain.labelId == chainId) {
+                        chainIdx = chain.idx;
+                    }
+                }
+                if (chainIdx == -1) {
+                    continue;
+                }
+                if (refChainIdx == -1) {
+                    refChainIdx = chainIdx;
+                    continue;
+                }
+                symmetryMate mate;
+                mate.refChainIdx = refChainIdx;
+                mate.chainIdx = chainIdx;
+                if (matchAtoms(mate) && superpositionRmsd(mate) < maxRmsd) {
+                    mates.push_back(std::move(mate));
+                }
+            }
+        }
+        return mates;
+    }
+
+    bool Surface::matchAtoms(symmetryMate& mate) const {
+        auto& chain1 = protein.chains[mate.refChainIdx];
+        auto& chain2 = protein.chains[mate.chainIdx];
+        if (chain1.residues.size() != chain2.residues.size()) {
+            return false;
+        }
+        for (unsigned long int i=0; i<chain1.residues.size(); i++) {
+            auto& r1 = chain1.residues[i];
+            auto& r2 = chain2.residues[i];
+            if (r1.selected != r2.selected || r1.gemmi.name != r2.gemmi.name
+                || r1.atoms.size() != r2.atoms.size()) {
+                return false;
+            }
+            if (!r1.selected) {
+                continue;
+            }
+            for (unsigned long int j=0; j<r1.atoms.size(); j++) {
+                if (r1.atoms[j].gemmi.name != r2.atoms[j].gemmi.name) {
+                    return false;
+                }
+                mate.atoms.emplace_back(&r1.atoms[j],&r2.atoms[j]);
+            }
+        }
+        return !mate.atoms.empty();
+    }
+
+    double Surface::superpositionRmsd(const symmetryMate& mate) const {
+        Eigen::Vector3d c1 = Eigen::Vector3d::Zero();
+        Eigen::Vector3d c2 = Eigen::Vector3d::Zero();
+        for (const auto& [a1, a2]: mate.atoms) {
+            c1 += Eigen::Vector3d(a1->gemmi.pos.x,a1->gemmi.pos.y,a1->gemmi.pos.z);
+            c2 += Eigen::Vector3d(a2->gemmi.pos.x,a2->gemmi.pos.y,a2->gemmi.pos.z);
+        }
+        c1 /= (double)mate.atoms.size();
+        c2 /= (double)mate.atoms.size();
+        Eigen::Matrix3d H = Eigen::Matrix3d::Zero();
+        for (const auto& [a1, a2]: mate.atoms) {
+            H += (Eigen::Vector3d(a1->gemmi.pos.x,a1->gemmi.pos.y,a1->gemmi.pos.z) - c1)
+                * (Eigen::Vector3d(a2->gemmi.pos.x,a2->gemmi.pos.y,a2->gemmi.pos.z) - c2).transpose();
+        }
+        //Kabsch rotation of the reference chain onto the mate
+        Eigen::JacobiSVD<Eigen::Matrix3d> svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
+        Eigen::Matrix3d D = Eigen::Matrix3d::Identity();
+        D(2,2) = ((svd.matrixV() * svd.matrixU().transpose()).determinant() < 0?-1.0:1.0);
+        Eigen::Matrix3d R = svd.matrixV() * D * svd.matrixU().transpose();
+        double sum = 0.0;
+        for (const auto& [a1, a2]: mate.atoms) {
+            Eigen::Vector3d p = R * (Eigen::Vector3d(a1->gemmi.pos.x,a1->gemmi.pos.y,a1->gemmi.pos.z) - c1) + c2;
+            sum += (p - Eigen::Vector3d(a2->gemmi.pos.x,a2->gemmi.pos.y,a2->gemmi.pos.z)).squaredNorm();
+        }
+        return sqrt(sum / mate.atoms.size());
+    }
+
+    bool Surface::copySurface(const symmetryMate& mate) {
+        const int sample = std::stoi(environment.get("TMDET_SURF_SYM_SAMPLE",DEFAULT_TMDET_SURF_SYM_SAMPLE));
+        const double tolerance = std::stof(environment.get("TMDET_SURF_SYM_TOL",DEFAULT_TMDET_SURF_SYM_TOL));
+        //evenly distributed sample of the atoms is calculated directly
+        unsigned long int step = std::max(1UL, mate.atoms.size() / (unsigned long int)std::max(sample,1));
+        surfTemp st;
+        for (unsigned long int i=0; i<mate.atoms.size(); i+=step) {
+            setContactsOfAtom(*mate.atoms[i].second,st);
+            if (std::abs(mate.atoms[i].second->surface - mate.atoms[i].first->surface) > tolerance) {
+                return false;
+            }
+        }
+        for (const auto& [a1, a2]: mate.atoms) {
+            a2->surface = a1->surface;
+        }
+        return true;
+    }
+
+    void Surface::setContactsInParallel(const std::vector<Tmdet::VOs::Atom*>& atoms) {
+        //atoms are distributed dynamically in small blocks, because the
+        //cost of atoms depends on the number of their neighbors
+        const unsigned long int block = 64;
+        std::atomic<unsigned long int> next = 0;
+        std::vector<std::thread> threads;
+        for (int t=0; t<numThreads; t++) {
+            threads.emplace_back(
+                [&]() -> void {
+                    surfTemp st;
+                    unsigned long int beg;
+                    while((beg = next.fetch_add(block)) < atoms.size()) {
+                        unsigned long int end = std::min(beg + block, atoms.size());
+                        for (unsigned long int i=beg; i<end; i++) {
+                            setContactsOfAtom(*atoms[i],st);
+                        }
+                    }
+                }
+            );
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    }
+
+    void Surface::buildContacts() {
+        contacts->index.clear();
+        contacts->pos.clear();
+        contacts->vdw.clear();
+        contacts->surface.clear();
+        contacts->offsets.clear();
+        contacts->neighbors.clear();
+        protein.eachSelectedResidue(
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                for(auto& atom: residue.atoms) {
+                    contacts->index[&atom] = (int)contacts->pos.size();
+                    contacts->pos.push_back(atom.gemmi.pos);
+                    contacts->vdw.push_back(vdw(atom));
+                    contacts->surface.push_back(atom.surface);
+                }
+            }
+        );
+        contacts->offsets.push_back(0);
+        std::vector<int> ids;
+        protein.eachSelectedResidue(
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                for(auto& a_atom: residue.atoms) {
+                    cellList.find(a_atom.gemmi, 0.1, 7.0, ids);
+                    for(auto id : ids) {
+                        auto& b_atom = cellList.atom(id);
+                        if (a_atom.gemmi.pos.dist(b_atom.gemmi.pos) < vdw(a_atom) + radius[id]) {
+                            contacts->neighbors.push_back(contacts->index.at(&b_atom));
+                        }
+                    }
+                    contacts->offsets.push_back(contacts->neighbors.size());
+                }
+            }
+        );
+        contacts->built = true;
+    }
+
+    bool Surface::setContactsFromStore() {
+        //the actual coordinates can be transformed, so the original ones are used
+        std::vector<bool> selected(contacts->pos.size(),false);
+        bool covered = true;
+        protein.eachSelectedResidue(
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                for(auto& atom: residue.atoms) {
+                    if (auto it = contacts->index.find(&atom); it != contacts->index.end()) {
+                        selected[it->second] = true;
+                    }
+                    else {
+                        covered = false;
+                    }
+                }
+            }
+        );
+        if (!covered) {
+            return false;
+        }
         surfTemp st;
-        for(auto m : protein.neighbors.find_neighbors(a_atom.gemmi, 0.1, 7.0)) {
-            if (protein.chains[m->chain_idx].selected 
-                && protein.chains[m->chain_idx].residues[m->residue_idx].selected) {
-                auto& b_atom = protein.chains[m->chain_idx].residues[m->residue_idx].atoms[m->atom_idx];
-                double dist = a_atom.gemmi.pos.dist(b_atom.gemmi.pos);
-                if ( dist < VDW(a_atom) + VDW(b_atom)) {
-                    setNeighbor(a_atom,b_atom,st);
+        protein.eachSelectedResidue(
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                residue.surface = 0.0;
+                for(auto& atom: residue.atoms) {
+                    int i = contacts->index.at(&atom);
+                    unsigned int beg = contacts->offsets[i];
+                    unsigned int end = contacts->offsets[i+1];
+                    bool intact = true;
+                    for (unsigned int k=beg; k<end && intact; k++) {
+                        intact = selected[contacts->neighbors[k]];
+                    }
+                    if (intact) {
+                        atom.surface = contacts->surface[i];
+                    }
+                    else {
+                        clearNeighbors(st);
+                        for (unsigned int k=beg; k<end; k++) {
+                            int j = contacts->neighbors[k];
+                            if (selected[j]) {
+                                setNeighbor(contacts->pos[i],contacts->pos[j],contacts->vdw[j],st);
+                            }
+                        }
+                        resizeNeighbors(st);
+                        atom.surface = (engine == "SR"?
+                            calcSurfaceOfAtomSR(contacts->vdw[i],st):
+                            calcSurfaceOfAtom(contacts->pos[i].z,contacts->vdw[i],st));
+                    }
+                    residue.surface += atom.surface;
                 }
             }
+        );
+        return true;
+    }
+
+    void Surface::setContactsOfAtom(Tmdet::VOs::Atom& a_atom, surfTemp& st) {
+        setNeighbors(a_atom, st);
+        if (engine == "SR") {
+            a_atom.surface = calcSurfaceOfAtomSR(a_atom, st);
+        }
+        else {
+            calcSurfaceOfAtom(a_atom, st);
+        }
+    }
+
+    void Surface::initSpherePoints() {
+        int n = std::stoi(environment.get("TMDET_SURF_POINTS",DEFAULT_TMDET_SURF_POINTS));
+        n = (n<64?64:n);
+        pointX.clear();
+        pointY.clear();
+        pointZ.clear();
+        const double goldenAngle = M_PI * (3.0 - sqrt(5.0));
+        for (int i=0; i<n; i++) {
+            double z = 1.0 - 2.0 * (i + 0.5) / n;
+            double r = sqrt(1.0 - z * z);
+            pointX.push_back(cos(goldenAngle * i) * r);
+            pointY.push_back(sin(goldenAngle * i) * r);
+            pointZ.push_back(z);
         }
-        calcSurfaceOfAtom(a_atom, st);
+    }
+
+    double Surface::calcSurfaceOfAtomSR(const Tmdet::VOs::Atom& a_atom, surfTemp& st) const {
+        return calcSurfaceOfAtomSR(vdw(a_atom),st);
+    }
+
+    double Surface::calcSurfaceOfAtomSR(const double ra, surfTemp& st) const {
+        const unsigned long int n = pointX.size();
+        const unsigned long int words = (n + 63) / 64;
+        const Tmdet::real* ux = pointX.data();
+        const Tmdet::real* uy = pointY.data();
+        const Tmdet::real* uz = pointZ.data();
+        st.mask.assign(words,0);
+        //padding bits of the last word are occluded
+        if (n % 64) {
+            st.mask[words-1] = ~((uint64_t(1) << (n % 64)) - 1);
+        }
+        //point u of the atom is inside neighbor c (relative position) if
+        //|ra*u - c|^2 < rb^2, i.e. u*c > (ra^2 + |c|^2 - rb^2) / (2*ra)
+        for (unsigned long int j=0; j<st.cx.size(); j++) {
+            const Tmdet::real cx = st.cx[j];
+            const Tmdet::real cy = st.cy[j];
+            const Tmdet::real cz = st.cz[j];
+            const Tmdet::real t = (ra * ra + cx * cx + cy * cy + cz * cz - st.vdw[j] * st.vdw[j]) / (2 * ra);
+            bool covered = true;
+            for (unsigned long int w=0; w<words; w++) {
+                const unsigned long int beg = w * 64;
+                const unsigned long int end = (beg + 64 < n ? beg + 64 : n);
+                uint64_t bits = 0;
+                for (unsigned long int k=beg; k<end; k++) {
+                    bits |= uint64_t(ux[k] * cx + uy[k] * cy + uz[k] * cz > t) << (k - beg);
+                }
+                st.mask[w] |= bits;
+                covered = covered && (st.mask[w] == ~uint64_t(0));
+            }
+            if (covered) {
+                return 0.0;
+            }
+        }
+        unsigned long int occluded = 0;
+        for (auto bits: st.mask) {
+            occluded += std::popcount(bits);
+        }
+        return 4.0 * M_PI * ra * ra * (double)(words * 64 - occluded) / n;
+    }
+
+    void Surface::clearNeighbors(surfTemp& st) const {
+        st.z.clear();
+        st.vdw.clear();
+        st.d.clear();
+        st.d2.clear();
+        st.beta.clear();
+        st.cx.clear();
+        st.cy.clear();
+        st.cz.clear();
+    }
+
+    void Surface::resizeNeighbors(surfTemp& st) const {
+        auto n = st.z.size();
+        st.rb2.resize(n);
+        st.rb.resize(n);
+        st.q.resize(n);
+        st.alpha.resize(n);
+        st.intersecting.resize(n);
+        st.arcs.resize(2*n);
+    }
+
+    void Surface::setNeighbors(const Tmdet::VOs::Atom& a_atom, surfTemp& st) {
+        clearNeighbors(st);
+        const double vdwa = vdw(a_atom);
+        cellList.find(a_atom.gemmi, 0.1, 7.0, st.ids);
+        for(auto id : st.ids) {
+            const auto& b_pos = cellList.atom(id).gemmi.pos;
+            double dist = a_atom.gemmi.pos.dist(b_pos);
+            if ( dist < vdwa + radius[id]) {
+                setNeighbor(a_atom.gemmi.pos,b_pos,radius[id],st);
+            }
+        }
+        resizeNeighbors(st);
     }
 
     void Surface::setNeighbor(const Tmdet::VOs::Atom& a_atom, const Tmdet::VOs::Atom& b_atom, surfTemp& st) {
-        double dx=a_atom.gemmi.pos.x-b_atom.gemmi.pos.x;
-        double dy=a_atom.gemmi.pos.y-b_atom.gemmi.pos.y;
+        setNeighbor(a_atom.gemmi.pos,b_atom.gemmi.pos,vdw(b_atom),st);
+    }
+
+    void Surface::setNeighbor(const gemmi::Position& a, const gemmi::Position& b, const double vdwb, surfTemp& st) const {
+        double dx=a.x-b.x;
+        double dy=a.y-b.y;
         double d2 = (dx*dx)+(dy*dy);
         double d = sqrt(d2);
         double beta = atan2(dx,dy)+M_PI;
-        surfNeighbor sn = {b_atom, d, d2, beta};
-        st.neighbors.emplace_back(sn);
+        st.z.push_back(b.z);
+        st.vdw.push_back(vdwb);
+        st.d.push_back(d);
+        st.d2.push_back(d2);
+        st.beta.push_back(beta);
+        st.cx.push_back(-dx);
+        st.cy.push_back(-dy);
+        st.cz.push_back(b.z - a.z);
     }
 
     void Surface::calcSurfaceOfAtom(Tmdet::VOs::Atom& a_atom, surfTemp& st) {
-        const double zSlice = std::stof(environment.get("TMDET_SURF_ZSLICE",DEFAULT_TMDET_SURF_ZSLICE));
-        a_atom.surface = 0.0;
+        a_atom.surface = calcSurfaceOfAtom(a_atom.gemmi.pos.z,vdw(a_atom),st);
+    }
+
+    double Surface::calcSurfaceOfAtom(const double za, const double vdwa, surfTemp& st) const {
+        double surface = 0.0;
+        for(double z=za-vdwa+zSlice/2; z<za+vdwa; z+=zSlice) {
+            surface += calcSliceOfAtom(za,vdwa,st,z) * zSlice;
+        }
+        return surface * vdwa;
+    }
+
+    double Surface::calcSliceOfAtom(const double za, const double vdwa, surfTemp& st, const double z) const {
+        const Tmdet::real zs = z;
+        const Tmdet::real ra2 = vdwa * vdwa - (za - z) * (za - z);
+        const Tmdet::real ra = std::sqrt(ra2);
+        const int n = (int)st.z.size();
+        const Tmdet::real* bz = st.z.data();
+        const Tmdet::real* vdw = st.vdw.data();
+        const Tmdet::real* d = st.d.data();
+        const Tmdet::real* d2 = st.d2.data();
+        Tmdet::real* rb2 = st.rb2.data();
+        Tmdet::real* rb = st.rb.data();
+
+        //circles of neighbors in the slice (branch free, vectorisable)
+        for (int i=0; i<n; i++) {
+            Tmdet::real dz = bz[i] - zs;
+            rb2[i] = vdw[i] * vdw[i] - dz * dz;
+            rb[i] = std::sqrt(rb2[i]>0?rb2[i]:Tmdet::real(0));
+        }
+
+        //collect the intersecting circles, the atom is buried in the slice
+        //if it is inside a bigger circle
+        int m = 0;
+        for (int i=0; i<n; i++) {
+            if (std::abs(bz[i] - zs) < vdw[i]) {
+                if (d[i] < std::abs(ra-rb[i])) {
+                    if (ra<rb[i]) {
+                        return 0.0;
+                    }
+                }
+                else if (d[i] < ra+rb[i] && d[i] > std::abs(ra-rb[i])) {
+                    st.q[m] = (d2[i]+ra2-rb2[i]) / (2*d[i]*ra);
+                    st.intersecting[m] = i;
+                    m++;
+                }
+            }
+        }
+
+        //half angles of the arcs (vectorisable)
+        Tmdet::real* q = st.q.data();
+        Tmdet::real* alpha = st.alpha.data();
+        for (int k=0; k<m; k++) {
+            Tmdet::real c = (q[k]>1?Tmdet::real(1):q[k]);
+            c = (c<-1?Tmdet::real(-1):c);
+            alpha[k] = std::acos(c);
+        }
+
+        //arcs, the ones containing the 0 angle are split into two
+        auto* arcs = st.arcs.data();
+        const Tmdet::real pi2 = 2*M_PI;
+        int na = 0;
+        for (int k=0; k<m; k++) {
+            Tmdet::real beta = st.beta[st.intersecting[k]];
+            Tmdet::real arc1 = beta - alpha[k];
+            Tmdet::real arc2 = beta + alpha[k];
+            arc1 = (arc1<0?arc1+pi2:arc1);
+            arc2 = (arc2>pi2?arc2-pi2:arc2);
+            if (arc1 < arc2) {
+                arcs[na++] = {arc1, arc2};
+            }
+            else {
+                arcs[na++] = {arc1, pi2};
+                arcs[na++] = {0, arc2};
+            }
+        }
+
+        //sort arcs by their beginning (insertion sort is the fastest for
+        //the typical few arcs)
+        if (na > 32) {
+            std::sort(arcs, arcs + na, [](const auto& a, const auto& b) { return a.first < b.first; });
+        }
+        else {
+            for (int i=1; i<na; i++) {
+                auto arc = arcs[i];
+                int j = i - 1;
+                for (; j>=0 && arcs[j].first > arc.first; j--) {
+                    arcs[j+1] = arcs[j];
+                }
+                arcs[j+1] = arc;
+            }
+        }
+
+        //sum up the free arcs
+        double arcsum = 2.0*M_PI;
+        for(int i=0; i<na;) {
+            double beg = arcs[i].first;
+            double end = arcs[i].second;
+            int j;
+            for(j=i+1; j<na && arcs[j].first<end; j++) {
+                end = (arcs[j].second > end ? arcs[j].second : end);
+            }
+            arcsum-=(end-beg);
+            i=j;
+        }
+        return arcsum;
+    }
+
+    //reference arc kernel, it is kept only for the arc kernel benchmark (-sb)
+    double Surface::calcSurfaceOfAtomReference(const Tmdet::VOs::Atom& a_atom, const surfTemp& st, surfReferenceTemp& rt) const {
+        double surface = 0.0;
         const auto& a_gatom = a_atom.gemmi;
-        double vdwa = VDW(a_atom);
+        double vdwa = vdw(a_atom);
         for(double z=a_gatom.pos.z-vdwa+zSlice/2; z<a_gatom.pos.z+vdwa; z+=zSlice) {
-            a_atom.surface += calcSumArcsOfAtom(a_atom,st,calcArcsOfAtom(a_atom,st,z)) * zSlice;
+            surface += calcSumArcsOfAtom(rt,calcArcsOfAtom(a_atom,st,rt,z)) * zSlice;
         }
-        a_atom.surface *= vdwa;
+        return surface * vdwa;
     }
 
-    bool Surface::calcArcsOfAtom(Tmdet::VOs::Atom& a_atom, surfTemp& st, double z) {
-        double vdwa = VDW(a_atom);
+    bool Surface::calcArcsOfAtom(const Tmdet::VOs::Atom& a_atom, const surfTemp& st, surfReferenceTemp& rt, double z) const {
+        double vdwa = vdw(a_atom);
         double ra2 = vdwa * vdwa - (a_atom.gemmi.pos.z - z) * (a_atom.gemmi.pos.z - z);
         double ra = sqrt(ra2);
         bool ss = true;
-        st.arc1.clear();
-        st.arc2.clear();
-        st.sorted.clear();
-        for(auto& neighbor: st.neighbors) {
+        rt.arc1.clear();
+        rt.arc2.clear();
+        rt.sorted.clear();
+        for(unsigned long int i=0; i<st.z.size(); i++) {
             if (ss) {
-                auto& b_atom = neighbor.atom;
-                const auto& b_gatom = b_atom.gemmi;
-                double vdwb = VDW(b_atom);
-                if (fabs(b_gatom.pos.z -z) < vdwb) {    
-                    double rb2 = vdwb * vdwb - (b_gatom.pos.z - z) * (b_gatom.pos.z - z);
+                double vdwb = st.vdw[i];
+                if (fabs(st.z[i] -z) < vdwb) {    
+                    double rb2 = vdwb * vdwb - (st.z[i] - z) * (st.z[i] - z);
                     double rb = sqrt(rb2);
-                    if ( neighbor.d < fabs(ra-rb)) {
+                    if ( st.d[i] < fabs(ra-rb)) {
                         if (ra<rb) {
                             ss = false;
                         }
                     }
-                    else if ( neighbor.d < ra+rb && neighbor.d > fabs(ra-rb)) {
-                        double q = (neighbor.d2+ra2-rb2) / (2*neighbor.d*ra);
+                    else if ( st.d[i] < ra+rb && st.d[i] > fabs(ra-rb)) {
+                        double q = (st.d2[i]+ra2-rb2) / (2*st.d[i]*ra);
                         q = (q>1?1.0:q);
                         q = (q<-1?-1.0:q);
                         double alpha = acos(q);
-                        double arc1 = neighbor.beta - alpha;
-                        double arc2 = neighbor.beta + alpha;
+                        double arc1 = st.beta[i] - alpha;
+                        double arc2 = st.beta[i] + alpha;
                         arc1 = (arc1<0?arc1+2*M_PI:arc1);
                         arc2 = (arc2>2*M_PI?arc2-2*M_PI:arc2);
                         if (arc1 < arc2) {
-                            st.arc1.emplace_back(arc1);
-                            st.arc2.emplace_back(arc2);
+                            rt.arc1.emplace_back(arc1);
+                            rt.arc2.emplace_back(arc2);
                         }
                         else {
-                            st.arc1.emplace_back(arc1);
-                            st.arc2.emplace_back(2*M_PI);
-                            st.arc1.emplace_back(0);
-                            st.arc2.emplace_back(arc2);
+                            rt.arc1.emplace_back(arc1);
+                            rt.arc2.emplace_back(2*M_PI);
+                            rt.arc1.emplace_back(0);
+                            rt.arc2.emplace_back(arc2);
                         }
                     }
                 }
@@ -225,22 +786,22 @@ namespace Tmdet::Utils {
         return ss;
     }
 
-    double Surface::calcSumArcsOfAtom(const Tmdet::VOs::Atom& atom, surfTemp& st, bool ss) const {
+    double Surface::calcSumArcsOfAtom(surfReferenceTemp& rt, bool ss) const {
         double arcsum = (ss?2.0*M_PI:0.0);
-        int n = (int)(st.arc1.size());
+        int n = (int)(rt.arc1.size());
         if (ss && n>0) {
-            st.sorted = vector<int>(n);
-            iota(st.sorted.begin(),st.sorted.end(),0);
-            sort( st.sorted.begin(),st.sorted.end(), [&](int i,int j) {
-                return st.arc1[i]<st.arc1[j];
+            rt.sorted = vector<int>(n);
+            iota(rt.sorted.begin(),rt.sorted.end(),0);
+            sort( rt.sorted.begin(),rt.sorted.end(), [&](int i,int j) {
+                return rt.arc1[i]<rt.arc1[j];
             });
             for(int i=0; i<n;) {
-                double beg = st.arc1.at(st.sorted.at(i));
-                double end = st.arc2.at(st.sorted.at(i));
+                double beg = rt.arc1.at(rt.sorted.at(i));
+                double end = rt.arc2.at(rt.sorted.at(i));
                 int j;
-                for(j=i+1; (j<n && st.arc1.at(st.sorted.at(j))<end); j++) {
-                    if (st.arc2.at(st.sorted.at(j)) > end) {
-                        end = st.arc2.at(st.sorted.at(j));
+                for(j=i+1; (j<n && rt.arc1.at(rt.sorted.at(j))<end); j++) {
+                    if (rt.arc2.at(rt.sorted.at(j)) > end) {
+                        end = rt.arc2.at(rt.sorted.at(j));
                     }
                 }
                 arcsum-=(end-beg);
@@ -250,178 +811,246 @@ namespace Tmdet::Utils {
         return arcsum;
     }
 
-    void Surface::setOutsideSurface() {
-       /* boundingBox box;
-        setBoundingBox(box);
-        initFrame(box);
-        setFrame(box);
-        smoothFrame(box);
-        findClosestAtoms(box);
-        for (int z=0; z<(box.zmax-box.zmin); z++) {
-	        for (int i=0; i<box.op; i++) {
-	            if (box.closestAtoms[z][i]!=NULL) {
-                    box.closestAtoms[z][i]->outSurface = box.closestAtoms[z][i]->surface;
-                }
-            }
-        }*/
+    void Surface::compareEngines() {
+        std::vector<Tmdet::VOs::Atom*> atoms;
         protein.eachSelectedResidue(
             [&](Tmdet::VOs::Residue& residue) -> void {
-                double q = 0;
                 for(auto& atom: residue.atoms) {
-                    atom.outSurface = atom.surface;
-                    q += atom.outSurface;
+                    atoms.push_back(&atom);
                 }
-                residue.outSurface = q;
             }
         );
-	}
+        surfTemp st;
+        std::chrono::duration<double> lrTime(0);
+        std::chrono::duration<double> srTime(0);
+        double lrSum = 0.0;
+        double srSum = 0.0;
+        double maxDiff = 0.0;
+        double sumDiff = 0.0;
+        for(auto atom: atoms) {
+            setNeighbors(*atom,st);
+            auto t0 = std::chrono::steady_clock::now();
+            calcSurfaceOfAtom(*atom,st);
+            auto t1 = std::chrono::steady_clock::now();
+            double sr = calcSurfaceOfAtomSR(*atom,st);
+            auto t2 = std::chrono::steady_clock::now();
+            lrTime += t1 - t0;
+            srTime += t2 - t1;
+            lrSum += atom->surface;
+            srSum += sr;
+            maxDiff = std::max(maxDiff,std::abs(sr - atom->surface));
+            sumDiff += std::abs(sr - atom->surface);
+        }
+        std::cout << "Surface engine comparison (" << protein.code << ", "
+            << atoms.size() << " atoms, " << pointX.size() << " sphere points)" << std::endl;
+        std::cout << "  Lee-Richards:   " << lrTime.count() << " s, total surface: " << lrSum << std::endl;
+        std::cout << "  Shrake-Rupley:  " << srTime.count() << " s, total surface: " << srSum << std::endl;
+        std::cout << "  speedup: " << (srTime.count()>0?lrTime.count()/srTime.count():0.0)
+            << ", relative difference of total: " << (lrSum>0?(srSum-lrSum)/lrSum:0.0)
+            << ", mean/maximal difference of atoms: " << (atoms.empty()?0.0:sumDiff/atoms.size())
+            << "/" << maxDiff << std::endl;
+    }
 
-    void Surface::setBoundingBox(boundingBox& box) const {
-        box.xmin=10000; box.xmax=-10000;        
-	    box.ymin=10000; box.ymax=-10000;        
-        box.zmin=10000; box.zmax=-10000;        
-	    
+    void Surface::benchmarkArcKernel() {
+        std::vector<Tmdet::VOs::Atom*> atoms;
         protein.eachSelectedResidue(
             [&](Tmdet::VOs::Residue& residue) -> void {
-                for(const auto& atom: residue.atoms) {
-                    box.xmin = MIN(box.xmin,atom.gemmi.pos.x);
-                    box.xmax = MAX(box.xmax,atom.gemmi.pos.x);
-                    box.ymin = MIN(box.ymin,atom.gemmi.pos.y);
-                    box.ymax = MAX(box.ymax,atom.gemmi.pos.y);
-                    box.zmin = MIN(box.zmin,atom.gemmi.pos.z);
-                    box.zmax = MAX(box.zmax,atom.gemmi.pos.z);
+                for(auto& atom: residue.atoms) {
+                    atoms.push_back(&atom);
                 }
             }
         );
-	    box.xmin=ceil(box.xmin-1)-2; box.xmax=ceil(box.xmax)+2;
-	    box.ymin=ceil(box.ymin-1)-2; box.ymax=ceil(box.ymax)+2;
-        box.zmin=ceil(box.zmin-1)-2; box.zmax=ceil(box.zmax)+2;
-
-        box.l1 = (box.xmax - box.xmin) + 1; 
-	    box.l2 = 2 * (box.xmax - box.xmin) + 2;
-	    box.l3 = 2 * (box.xmax - box.xmin) + 2 + (box.ymax - box.ymin) + 1;	
-	    box.op = 2 * (box.xmax - box.xmin) + 2 * (box.ymax - box.ymin) + 4;
+        surfTemp st;
+        surfReferenceTemp rt;
+        std::chrono::duration<double> refTime(0);
+        std::chrono::duration<double> newTime(0);
+        double maxDiff = 0.0;
+        double refSum = 0.0;
+        for(auto atom: atoms) {
+            setNeighbors(*atom,st);
+            auto t0 = std::chrono::steady_clock::now();
+            double ref = calcSurfaceOfAtomReference(*atom,st,rt);
+            auto t1 = std::chrono::steady_clock::now();
+            calcSurfaceOfAtom(*atom,st);
+            auto t2 = std::chrono::steady_clock::now();
+            refTime += t1 - t0;
+            newTime += t2 - t1;
+            refSum += ref;
+            maxDiff = std::max(maxDiff,std::abs(ref - atom->surface));
+        }
+        std::cout << "Surface arc kernel benchmark (" << protein.code << ", "
+            << atoms.size() << " atoms)" << std::endl;
+        std::cout << "  reference kernel: " << refTime.count() << " s" << std::endl;
+        std::cout << "  current kernel:   " << newTime.count() << " s" << std::endl;
+        std::cout << "  speedup: " << (newTime.count()>0?refTime.count()/newTime.count():0.0)
+            << ", total surface: " << refSum << ", maximal difference of atoms: " << maxDiff << std::endl;
     }
 
-    void Surface::initFrame(boundingBox& box) {
-        for (int i=0; i<(box.zmax-box.zmin)+1; i++) {
-            box.closestAtoms.emplace_back(vector<Tmdet::VOs::Atom *>(box.op));
-            box.frame.emplace_back(vector<gemmi::Position>(box.op));
+    void Surface::setOutsideSurface() {
+        if (!outside) {
+            protein.eachSelectedResidue(
+                [&](Tmdet::VOs::Residue& residue) -> void {
+                    double q = 0;
+                    for(auto& atom: residue.atoms) {
+                        atom.outSurface = atom.surface;
+                        q += atom.outSurface;
+                    }
+                    residue.outSurface = q;
+                }
+            );
+            return;
         }
-        box.closestDist = vector<double>(box.zmax-box.zmin+1);
-    
-        for (int z=0; z < (box.zmax-box.zmin)+1; z++) {
-            int i,k;
-        	for (i=0, k=0; i<box.l1; i++,k++)  {
-            	box.frame[z][i].x = k+box.ymin;
-                box.frame[z][i].y = box.ymax;
-                box.frame[z][i].z = 0;
-            }
-            for (i=box.l1, k=0; i<box.l2; i++,k++) {
-            	box.frame[z][i].x = k+box.ymin;
-                box.frame[z][i].y = box.ymin;
-                box.frame[z][i].z = 0;
-            }
-            for (i=box.l2, k=0; i<box.l3; i++,k++) {
-            	box.frame[z][i].x = k+box.xmin;
-                box.frame[z][i].y = box.ymax;
-                box.frame[z][i].z = 0;
-            }
-            for (i=box.l3, k=0; i<box.op; i++,k++) {
-            	box.frame[z][i].x = k+box.xmin;
-                box.frame[z][i].y = box.ymin;
-                box.frame[z][i].z = 0;
+        boundingBox box;
+        setBoundingBox(box);
+        for (int z=0; z<box.nz; z++) {
+            if (!box.layerAtoms[z].empty()) {
+                setLayer(box,z);
+                floodFillLayer(box);
+                setOutsideArcsOfLayer(box,z);
             }
         }
-    }
-
-    void Surface::setFrame(boundingBox& box) {
+        //the surface of a sphere zone depends only on its height, so the
+        //layers have equal weight
+        for (unsigned long int i=0; i<box.atoms.size(); i++) {
+            box.atoms[i]->outSurface = (box.freeArcs[i]>0?
+                box.atoms[i]->surface * box.outsideArcs[i] / box.freeArcs[i]:0.0);
+        }
         protein.eachSelectedResidue(
             [&](Tmdet::VOs::Residue& residue) -> void {
-                residue.outSurface = 0.0;
+                double q = 0;
                 for(auto& atom: residue.atoms) {
-                    atom.outSurface = 0.0;
-                    double x = floor(atom.gemmi.pos.x);
-                    double y = floor(atom.gemmi.pos.y);  	    
-                    int z = floor(atom.gemmi.pos.z) - box.zmin;
-                
-                    int k= (int)(x-box.xmin);
-                    box.frame[z][k].x = x;
-                    box.frame[z][k].y = MIN(box.frame[z][k].y,y-2);
-                    box.frame[z][k].z = (int)(atom.gemmi.pos.z); 
-                    
-                    box.frame[z][k+box.l1].x = x;
-                    box.frame[z][k+box.l1].y = MAX(box.frame[z][k+box.l1].y,y+2);
-                    box.frame[z][k+box.l1].z = (int)(atom.gemmi.pos.z);
-                    
-                    k=(int)(y-box.ymin);
-                    box.frame[z][k+box.l2].x = MIN(box.frame[z][k+box.l2].x, x-2);
-                    box.frame[z][k+box.l2].y = y;
-                    box.frame[z][k+box.l2].z = (int)(atom.gemmi.pos.z);
-                    
-                    box.frame[z][k+box.l3].x = MAX(box.frame[z][k+box.l3].x, x+2);
-                    box.frame[z][k+box.l3].y = y;
-                    box.frame[z][k+box.l3].z = (int)(atom.gemmi.pos.z);
+                    q += atom.outSurface;
                 }
+                residue.outSurface = q;
             }
         );
     }
 
-    void Surface::smoothFrame(boundingBox& box) {
-        for (int z=0; z<(box.zmax-box.zmin)+1; z++) {
-            int i,j;
-        	for (i=0; i<box.l1; i++) {
-                for (j=-2; j<2; j++) {
-                    if ((i+j>=0) && (i+j<box.l1) && box.frame[z][i+j].z!=0) {
-                        box.frame[z][i].y = MIN(box.frame[z][i+j].y, box.frame[z][i].y);
-                    }
+    const unsigned char EMPTY = 0;
+    const unsigned char OCCUPIED = 1;
+    const unsigned char OUTSIDE = 2;
+
+    void Surface::setBoundingBox(boundingBox& box) const {
+        box.step = std::stof(environment.get("TMDET_SURF_GRID",DEFAULT_TMDET_SURF_GRID));
+        box.step = (box.step<0.1?0.1:box.step);
+        double xmin=1e10, xmax=-1e10, ymin=1e10, ymax=-1e10, zmin=1e10, zmax=-1e10, vdwMax=0;
+        protein.eachSelectedResidue(
+            [&](Tmdet::VOs::Residue& residue) -> void {
+                for(auto& atom: residue.atoms) {
+                    box.atoms.push_back(&atom);
+                    xmin = MIN(xmin,atom.gemmi.pos.x);
+                    xmax = MAX(xmax,atom.gemmi.pos.x);
+                    ymin = MIN(ymin,atom.gemmi.pos.y);
+                    ymax = MAX(ymax,atom.gemmi.pos.y);
+                    zmin = MIN(zmin,atom.gemmi.pos.z);
+                    zmax = MAX(zmax,atom.gemmi.pos.z);
+                    vdwMax = MAX(vdwMax,vdw(atom));
                 }
             }
-            for (i=box.l1; i<box.l2; i++) {
-                for (j=-2; j<2; j++) {
-                    if ((i+j>=box.l1) && (i+j<box.l2) && box.frame[z][i+j].z!=0) {
-                        box.frame[z][i].y = MAX(box.frame[z][i+j].y, box.frame[z][i].y);
-                    }
-                }
+        );
+        box.freeArcs.assign(box.atoms.size(),0.0);
+        box.outsideArcs.assign(box.atoms.size(),0.0);
+        //margin of empty cells around the molecule, the flood fill starts from them
+        double margin = vdwMax + 2 * box.step;
+        box.xmin = xmin - margin;
+        box.ymin = ymin - margin;
+        box.zmin = zmin - vdwMax;
+        box.nx = (box.atoms.empty()?0:(int)((xmax - xmin + 2 * margin) / box.step) + 1);
+        box.ny = (box.atoms.empty()?0:(int)((ymax - ymin + 2 * margin) / box.step) + 1);
+        box.nz = (box.atoms.empty()?0:(int)((zmax - zmin + 2 * vdwMax) / box.step) + 1);
+        box.layerAtoms.resize(box.nz);
+        for (unsigned long int i=0; i<box.atoms.size(); i++) {
+            double z = box.atoms[i]->gemmi.pos.z;
+            double ra = vdw(*box.atoms[i]);
+            int beg = (int)ceil((z - ra - box.zmin) / box.step);
+            int end = (int)floor((z + ra - box.zmin) / box.step);
+            for (int k=MAX(beg,0); k<=end && k<box.nz; k++) {
+                box.layerAtoms[k].push_back((int)i);
             }
-            for (i=box.l2; i<box.l3; i++) {
-                for (j=-2; j<2; j++) {
-                    if ((i+j>=box.l2) && (i+j<box.l3) && box.frame[z][i+j].z!=0) {
-                        box.frame[z][i].x = MIN(box.frame[z][i+j].x, box.frame[z][i].x);
-                    }
-                }
+        }
+        box.cells.resize((unsigned long int)box.nx * box.ny);
+    }
+
+    void Surface::setLayer(boundingBox& box, int z) const {
+        std::fill(box.cells.begin(),box.cells.end(),EMPTY);
+        double zc = box.zmin + z * box.step;
+        for (auto i: box.layerAtoms[z]) {
+            const auto& pos = box.atoms[i]->gemmi.pos;
+            double ra = vdw(*box.atoms[i]);
+            double r2 = ra * ra - (pos.z - zc) * (pos.z - zc);
+            if (r2 <= 0) {
+                continue;
             }
-            for (i=box.l3; i<box.op; i++) {
-                for (j=-2; j<2; j++) {
-                    if ((i+j>=box.l3) && (i+j<box.op) && box.frame[z][i+j].z!=0) {
-                        box.frame[z][i].x = MAX(box.frame[z][i+j].x, box.frame[z][i].x);
+            double r = sqrt(r2);
+            int xbeg = MAX((int)ceil((pos.x - r - box.xmin) / box.step),0);
+            int xend = MIN((int)floor((pos.x + r - box.xmin) / box.step),box.nx-1);
+            int ybeg = MAX((int)ceil((pos.y - r - box.ymin) / box.step),0);
+            int yend = MIN((int)floor((pos.y + r - box.ymin) / box.step),box.ny-1);
+            for (int y=ybeg; y<=yend; y++) {
+                double dy = box.ymin + y * box.step - pos.y;
+                for (int x=xbeg; x<=xend; x++) {
+                    double dx = box.xmin + x * box.step - pos.x;
+                    if (dx * dx + dy * dy < r2) {
+                        box.cells[y * box.nx + x] = OCCUPIED;
                     }
                 }
             }
         }
     }
 
-    void Surface::findClosestAtoms(boundingBox& box) {
-        for (int i=0; i<box.op; i++) {
-		    for (int j=0; j<box.zmax-box.zmin; j++) {
-			    box.closestDist[j] = 10000000;
+    void Surface::floodFillLayer(boundingBox& box) const {
+        box.stack.clear();
+        auto push = [&](int x, int y) -> void {
+            if (x>=0 && x<box.nx && y>=0 && y<box.ny && box.cells[y * box.nx + x] == EMPTY) {
+                box.cells[y * box.nx + x] = OUTSIDE;
+                box.stack.push_back(y * box.nx + x);
             }
-            protein.eachSelectedResidue(
-                [&](Tmdet::VOs::Residue& residue) -> void {
-                    for(auto& atom: residue.atoms) {
-                        int z = (int)(atom.gemmi.pos.z-box.zmin);
-                        double dist = 
-                            (atom.gemmi.pos.x - box.frame[z][i].x) * 
-                            (atom.gemmi.pos.x - box.frame[z][i].x) +
-                            (atom.gemmi.pos.y - box.frame[z][i].y) *
-                            (atom.gemmi.pos.y - box.frame[z][i].y);
-                        if (dist < box.closestDist[z]) {
-                            box.closestAtoms[z][i] = &atom;
-                            box.closestDist[z]=dist;
-                        }
-                    }
-                }
-            );
-		}
- 	}
+        };
+        for (int x=0; x<box.nx; x++) {
+            push(x,0);
+            push(x,box.ny-1);
+        }
+        for (int y=0; y<box.ny; y++) {
+            push(0,y);
+            push(box.nx-1,y);
+        }
+        while (!box.stack.empty()) {
+            int c = box.stack.back();
+            box.stack.pop_back();
+            int x = c % box.nx;
+            int y = c / box.nx;
+            push(x-1,y);
+            push(x+1,y);
+            push(x,y-1);
+            push(x,y+1);
+        }
+    }
+
+    void Surface::setOutsideArcsOfLayer(boundingBox& box, int z) const {
+        double zc = box.zmin + z * box.step;
+        for (auto i: box.layerAtoms[z]) {
+            const auto& pos = box.atoms[i]->gemmi.pos;
+            double ra = vdw(*box.atoms[i]);
+            double r2 = ra * ra - (pos.z - zc) * (pos.z - zc);
+            if (r2 <= 0) {
+                continue;
+            }
+            //one sample for each cell along the circle, one cell away from it,
+            //so the nearest cell of a sample is not covered by the atom itself
+            double r = sqrt(r2) + box.step;
+            int n = MAX(8,(int)ceil(2 * M_PI * r / box.step));
+            int numFree = 0;
+            int numOutside = 0;
+            for (int k=0; k<n; k++) {
+                double angle = 2 * M_PI * k / n;
+                int x = (int)lround((pos.x + r * cos(angle) - box.xmin) / box.step);
+                int y = (int)lround((pos.y + r * sin(angle) - box.ymin) / box.step);
+                unsigned char cell = (x>=0 && x<box.nx && y>=0 && y<box.ny?box.cells[y * box.nx + x]:OUTSIDE);
+                numFree += (cell != OCCUPIED);
+                numOutside += (cell == OUTSIDE);
+            }
+            box.freeArcs[i] += (double)numFree / n;
+            box.outsideArcs[i] += (double)numOutside / n;
+        }
+    }
 }
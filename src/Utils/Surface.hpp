@@ -1,17 +1,21 @@
-// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
-//             Protein Bioinformatics Research Group 
-//             Research Center of Natural Sciences, HUN-REN
-//
-// License:    CC-BY-NC-4.0, see LICENSE.txt
-
+// © 2003-2024 Gabor E. Tusnady <tusnady.gabor@ttk.hu> and TmDet developer team
+//             Protein Bioinformatics Research Group 
+//             Research Center of Natural Sciences, HUN-REN
+//
+// License:    CC-BY-NC-4.0, see LICENSE.txt
+
 #pragma once
 
 #include <array>
 #include <any>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
 #include <gemmi/model.hpp>
+#include <Config.hpp>
 #include <VOs/Protein.hpp>
+#include <Utils/CellList.hpp>
 
-#define VDW(a) (any_cast<double>(a.temp["vdw"]))
 #define MIN(a,b) ((a)<(b)?(a):(b))
 #define MAX(a,b) ((a)>(b)?(a):(b))
 
@@ -21,99 +25,240 @@
 namespace Tmdet::Utils {
 
     /**
-     * @brief temporary geometry data for neighboring atom
+     * @brief temporary data for neighbors in structure of arrays layout,
+     *        containers are reused between atoms and z slices
      */
-    struct surfNeighbor {
-        Tmdet::VOs::Atom atom;
-        double d;
-        double d2;
-        double beta;
+    struct surfTemp {
+        /**
+         * @brief z coordinate and van der Waals radius (plus probe size)
+         *        of the neighbor atoms
+         */
+        std::vector<Tmdet::real> z;
+        std::vector<Tmdet::real> vdw;
+
+        /**
+         * @brief distance (and its square) and direction of the neighbor
+         *        atoms in the xy plane
+         */
+        std::vector<Tmdet::real> d;
+        std::vector<Tmdet::real> d2;
+        std::vector<Tmdet::real> beta;
+
+        /**
+         * @brief position of the neighbor atoms relative to the atom
+         *        (used by the Shrake-Rupley engine)
+         */
+        std::vector<Tmdet::real> cx;
+        std::vector<Tmdet::real> cy;
+        std::vector<Tmdet::real> cz;
+
+        /**
+         * @brief occluded sphere points of the atom, one bit for each point
+         *        (used by the Shrake-Rupley engine)
+         */
+        std::vector<uint64_t> mask;
+
+        /**
+         * @brief result of neighbor queries
+         */
+        std::vector<int> ids;
+
+        /**
+         * @brief squared radius and radius of neighbor circles in a z slice
+         */
+        std::vector<Tmdet::real> rb2;
+        std::vector<Tmdet::real> rb;
+
+        /**
+         * @brief cosine and half angle of the arcs of intersecting circles
+         *        and the index of the intersecting neighbors
+         */
+        std::vector<Tmdet::real> q;
+        std::vector<Tmdet::real> alpha;
+        std::vector<int> intersecting;
+
+        /**
+         * @brief covered arcs (begin, end) of a z slice
+         */
+        std::vector<std::pair<Tmdet::real,Tmdet::real>> arcs;
     };
 
     /**
-     * @brief temporary data for neighbors
+     * @brief temporary data of the reference arc kernel, it is used only
+     *        by the arc kernel benchmark
      */
-    struct surfTemp {
-        std::vector<surfNeighbor> neighbors;
+    struct surfReferenceTemp {
+        /**
+         * @brief covered arcs (begin, end) of a z slice and their order
+         */
         std::vector<double> arc1;
         std::vector<double> arc2;
         std::vector<int> sorted;
     };
 
     /**
-     * @brief the bounding box containing the molecule
+     * @brief the bounding box containing the molecule and a 2D grid
+     *        for one z layer of the box
      */
     struct boundingBox {
         double xmin;
-        double xmax;
         double ymin;
-        double ymax;
         double zmin;
-        double zmax;
-        int l1;
-        int l2;
-        int l3;
-        int op;
-        std::vector<std::vector<gemmi::Position>> frame;
-        std::vector<std::vector<Tmdet::VOs::Atom *>> closestAtoms;
-        std::vector<double> closestDist;
+        double step;
+        int nx;
+        int ny;
+        int nz;
+
+        /**
+         * @brief selected atoms, the free part of their circles and the part
+         *        accessible from outside (in full circles) summed up over the z layers
+         */
+        std::vector<Tmdet::VOs::Atom *> atoms;
+        std::vector<double> freeArcs;
+        std::vector<double> outsideArcs;
+
+        /**
+         * @brief indexes of atoms crossing the z layers
+         */
+        std::vector<std::vector<int>> layerAtoms;
+
+        /**
+         * @brief cells of the actual layer (EMPTY, OCCUPIED or OUTSIDE)
+         */
+        std::vector<unsigned char> cells;
+
+        /**
+         * @brief stack of the flood fill
+         */
+        std::vector<int> stack;
+    };
+
+    /**
+     * @brief chain of a homo-oligomer superposable to a reference chain,
+     *        its atom surfaces are copied from the reference chain
+     */
+    struct symmetryMate {
+        int refChainIdx;
+        int chainIdx;
+
+        /**
+         * @brief corresponding atoms (reference atom, mate atom)
+         */
+        std::vector<std::pair<Tmdet::VOs::Atom*,Tmdet::VOs::Atom*>> atoms;
+    };
+
+    /**
+     * @brief neighbor lists and surfaces of the atoms of a selection
+     *        (stored in compact form), used to derive the surface of
+     *        sub-selections (fragments) incrementally
+     */
+    struct surfaceContacts {
+        /**
+         * @brief flag if the contacts are set
+         */
+        bool built = false;
+
+        /**
+         * @brief index of atoms in the containers below
+         */
+        std::unordered_map<const Tmdet::VOs::Atom*,int> index;
+
+        /**
+         * @brief original position, radius and surface of the atoms
+         */
+        std::vector<gemmi::Position> pos;
+        std::vector<double> vdw;
+        std::vector<double> surface;
+
+        /**
+         * @brief neighbors of atom i are neighbors[offsets[i]..offsets[i+1])
+         */
+        std::vector<unsigned int> offsets;
+        std::vector<int> neighbors;
     };
 
     /**
-     * @brief surface cache data
+     * @brief header of the binary surface cache file, it is followed by
+     *        count float values (surface and outside surface of each atom)
+     */
+    struct surfaceCacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t checksum;
+        char key[32];
+    };
+
+    /**
+     * @brief surface cache data stored in a versioned, checksummed binary file
+     *        keyed by the digest of the coordinates and surface parameters
      */
     class surfaceCache {
         private:
             /**
-            * @brief the cache container
-            */
-            std::vector<double> cache;
+             * @brief digest of the coordinates and the surface parameters
+             */
+            std::string key;
+
+            /**
+             * @brief path of the cache file
+             */
+            std::string path() const;
+
+            /**
+             * @brief Number of float values stored for the protein
+             * 
+             * @param protein 
+             * @return uint32_t 
+             */
+            static uint32_t count(const Tmdet::VOs::Protein& protein);
 
             /**
             * @brief Convert cache data back to protein value object
             * 
             * @param protein 
+            * @param data 
             */
-            void proteinFromCache(Tmdet::VOs::Protein& protein);
+            void proteinFromCache(Tmdet::VOs::Protein& protein, const float* data) const;
 
             /**
-             * @brief Convert cache data back to chain value object
-             * 
-             * @param chain 
-             * @param index 
-             */
-            void chainFromCache(Tmdet::VOs::Chain& chain, unsigned int& index);
+            * @brief Convert protein value object to cache data
+            * 
+            * @param protein 
+            * @return std::vector<float> 
+            */
+            std::vector<float> proteinToCache(const Tmdet::VOs::Protein& protein) const;
 
+        public:
             /**
-             * @brief Convert protein value object to cache data
-             * 
-             * @param protein 
+             * @brief magic number and version of the cache file format
              */
-            void proteinToCache(const Tmdet::VOs::Protein& protein);
-        
+            static constexpr char MAGIC[8] = {'T','M','D','S','U','R','F','\0'};
+            static constexpr uint32_t VERSION = 3;
+
             /**
-             * @brief Convert chain value object to cache data
+             * @brief Construct a new surface cache object
              * 
-             * @param chain 
+             * @param key digest of the coordinates and surface parameters
              */
-            void chainToCache(const Tmdet::VOs::Chain& chain);
-
-        public:
+            explicit surfaceCache(const std::string& key) : key(key) {}
 
             /**
-            * @brief Read cache data from file and store it in protein value object
+            * @brief Read cache data from file by mmap, validate it
+            *        and store it in protein value object
             * 
             * @param protein 
-            * @return bool
+            * @return bool false if the file is missing or invalid
             */
-            bool read(Tmdet::VOs::Protein& protein);
+            bool read(Tmdet::VOs::Protein& protein) const;
 
             /**
-            * @brief Write cache data from protein value objects to file
+            * @brief Write cache data from protein value objects to file,
+            *        using temporary file and rename for atomic update
             * 
             * @param protein 
             */
-            void write(const Tmdet::VOs::Protein& protein);
+            void write(const Tmdet::VOs::Protein& protein) const;
     };
 
     /**
@@ -133,6 +278,96 @@ namespace Tmdet::Utils {
              */
             bool noCache = false;
 
+            /**
+             * @brief number of threads used for surface calculation
+             */
+            int numThreads = 1;
+
+            /**
+             * @brief flag for running the arc kernel benchmark
+             */
+            bool benchmark = false;
+
+            /**
+             * @brief surface engine: LR (Lee-Richards) or SR (Shrake-Rupley)
+             */
+            std::string engine;
+
+            /**
+             * @brief flag for calculating outside surface, otherwise
+             *        it is the same as the surface
+             */
+            bool outside = false;
+
+            /**
+             * @brief stored contacts of a larger selection (if not null),
+             *        they are set in the first run
+             */
+            surfaceContacts* contacts = nullptr;
+
+            /**
+             * @brief spatial index of the atoms for neighbor queries
+             */
+            CellList cellList;
+
+            /**
+             * @brief flag for calculating surface of one protomer of homo-oligomers
+             *        and copy it to the symmetry mates
+             */
+            bool symmetric = false;
+
+            /**
+             * @brief van der Waals radius plus probe size of the atoms
+             *        indexed by the atom id of the cell list
+             */
+            std::vector<double> radius;
+
+            /**
+             * @brief thickness of z slices (TMDET_SURF_ZSLICE)
+             */
+            double zSlice = 0.05;
+
+            /**
+             * @brief Radius of an atom (van der Waals radius plus probe size)
+             * 
+             * @param atom 
+             * @return double 
+             */
+            double vdw(const Tmdet::VOs::Atom& atom) const {
+                return radius[cellList.id(atom)];
+            }
+
+            /**
+             * @brief unit sphere points of the Shrake-Rupley engine
+             *        (Fibonacci lattice, structure of arrays)
+             */
+            std::vector<Tmdet::real> pointX;
+            std::vector<Tmdet::real> pointY;
+            std::vector<Tmdet::real> pointZ;
+
+            /**
+             * @brief Generate the unit sphere points of the Shrake-Rupley engine
+             */
+            void initSpherePoints();
+
+            /**
+             * @brief Calculate surface of one atom by the Shrake-Rupley method
+             * 
+             * @param a_atom 
+             * @param st 
+             * @return double 
+             */
+            double calcSurfaceOfAtomSR(const Tmdet::VOs::Atom& a_atom, surfTemp& st) const;
+
+            /**
+             * @brief Calculate surface of one atom by the Shrake-Rupley method
+             * 
+             * @param ra radius of the atom
+             * @param st 
+             * @return double 
+             */
+            double calcSurfaceOfAtomSR(const double ra, surfTemp& st) const;
+
             /**
              * @brief initialize temporary datat containers
              */
@@ -143,12 +378,98 @@ namespace Tmdet::Utils {
              */
             void setContacts();
 
+            /**
+             * @brief Calculate surface of the given atoms (serial or in parallel)
+             * 
+             * @param atoms 
+             */
+            void calcSurfaceOfAtoms(const std::vector<Tmdet::VOs::Atom*>& atoms);
+
+            /**
+             * @brief Find chains of homo-oligomers having the same atoms as the
+             *        first chain of the entity and superposable to it
+             * 
+             * @return std::vector<symmetryMate> 
+             */
+            std::vector<symmetryMate> getSymmetryMates() const;
+
+            /**
+             * @brief Match atoms of two chains (same residues and atom names)
+             * 
+             * @param mate 
+             * @return bool false if the chains are not identical
+             */
+            bool matchAtoms(symmetryMate& mate) const;
+
+            /**
+             * @brief Superposition rmsd of matched atoms
+             * 
+             * @param mate 
+             * @return double 
+             */
+            double superpositionRmsd(const symmetryMate& mate) const;
+
+            /**
+             * @brief Copy surface of reference atoms to the mate after
+             *        verifying a sample of atoms
+             * 
+             * @param mate 
+             * @return bool false if the sample differs, i.e. the environment
+             *         of the chains is not symmetric
+             */
+            bool copySurface(const symmetryMate& mate);
+
             /**
              * @brief Set contacts for one atom
              * 
              * @param a_atom 
+             * @param st temporary data (reused between atoms)
+             */
+            void setContactsOfAtom(Tmdet::VOs::Atom& a_atom, surfTemp& st);
+
+            /**
+             * @brief Calculate surface of the given atoms using worker threads,
+             *        each thread has its own temporary data
+             * 
+             * @param atoms 
+             */
+            void setContactsInParallel(const std::vector<Tmdet::VOs::Atom*>& atoms);
+
+            /**
+             * @brief Store the neighbor lists and surfaces of the selected atoms
+             *        into contacts
+             */
+            void buildContacts();
+
+            /**
+             * @brief Set the surface of the selected atoms from the stored contacts,
+             *        only atoms having unselected neighbors are recalculated
+             * 
+             * @return bool false if some selected atoms are not in the contacts
+             */
+            bool setContactsFromStore();
+
+            /**
+             * @brief Clear neighbor containers
+             * 
+             * @param st 
+             */
+            void clearNeighbors(surfTemp& st) const;
+
+            /**
+             * @brief Resize slice containers to the number of neighbors
+             * 
+             * @param st 
              */
-            void setContactsOfAtom(Tmdet::VOs::Atom& a_atom);
+            void resizeNeighbors(surfTemp& st) const;
+
+            /**
+             * @brief Collect the neighbors of an atom
+             * 
+             * @param a_atom 
+             * @param st 
+             */
+            void setNeighbors(const Tmdet::VOs::Atom& a_atom, surfTemp& st);
 
             /**
              * @brief Set the neighbors of atoms
@@ -159,6 +480,16 @@ namespace Tmdet::Utils {
              */
             void setNeighbor(const Tmdet::VOs::Atom& a_atom, const Tmdet::VOs::Atom& b_atom, surfTemp& st);
 
+            /**
+             * @brief Set the neighbors of atoms given by their positions
+             * 
+             * @param a position of the atom
+             * @param b position of the neighbor
+             * @param vdwb radius of the neighbor
+             * @param st 
+             */
+            void setNeighbor(const gemmi::Position& a, const gemmi::Position& b, const double vdwb, surfTemp& st) const;
+
             /**
              * @brief Calculate surface of one atom
              * 
@@ -167,67 +498,119 @@ namespace Tmdet::Utils {
              */
             void calcSurfaceOfAtom(Tmdet::VOs::Atom& atom,  surfTemp& st);
 
+            /**
+             * @brief Calculate surface of one atom
+             * 
+             * @param za z coordinate of the atom
+             * @param vdwa radius of the atom
+             * @param st 
+             * @return double 
+             */
+            double calcSurfaceOfAtom(const double za, const double vdwa, surfTemp& st) const;
+
+            /**
+             * @brief Calculate the free arc length of an atom in the given plane
+             *        (allocation free kernel)
+             * 
+             * @param za z coordinate of the atom
+             * @param vdwa radius of the atom
+             * @param st 
+             * @param z 
+             * @return double 
+             */
+            double calcSliceOfAtom(const double za, const double vdwa, surfTemp& st, const double z) const;
+
+            /**
+             * @brief Calculate surface of one atom by the reference kernel
+             *        (reference only, it is used by the arc kernel benchmark)
+             * 
+             * @param a_atom 
+             * @param st 
+             * @param rt 
+             * @return double 
+             */
+            double calcSurfaceOfAtomReference(const Tmdet::VOs::Atom& a_atom, const surfTemp& st, surfReferenceTemp& rt) const;
+
             /**
              * @brief Calculate arcs of overlaping atoms in the given plane
+             *        (reference kernel)
              * 
              * @param a_atom 
              * @param st 
+             * @param rt 
              * @param z 
              * @return true 
              * @return false 
              */
-            bool calcArcsOfAtom(Tmdet::VOs::Atom& a_atom, surfTemp& st, double z);
+            bool calcArcsOfAtom(const Tmdet::VOs::Atom& a_atom, const surfTemp& st, surfReferenceTemp& rt, double z) const;
 
             /**
-             * @brief Sum up overlaping arcs
+             * @brief Sum up overlaping arcs (reference kernel)
              * 
-             * @param atom 
-             * @param st 
+             * @param rt 
              * @param ss 
              * @return double 
              */
-            double calcSumArcsOfAtom(const Tmdet::VOs::Atom& atom, surfTemp& st, bool ss) const;
+            double calcSumArcsOfAtom(surfReferenceTemp& rt, bool ss) const;
 
             /**
-             * @brief Set up parameters of the bounding box object
+             * @brief Set up parameters of the bounding box object and
+             *        collect the atoms crossing each z layer
              * 
              * @param box 
              */
             void setBoundingBox(boundingBox& box) const;
 
             /**
-             * @brief Initialize frame for setting outside atoms
+             * @brief Mark cells of a z layer occupied by atoms
              * 
              * @param box 
+             * @param z 
              */
-            void initFrame(boundingBox& box);
+            void setLayer(boundingBox& box, int z) const;
 
             /**
-             * @brief Set up frame for setting outside atoms
+             * @brief Flood fill empty cells of a z layer from its border
              * 
              * @param box 
              */
-            void setFrame(boundingBox& box);
+            void floodFillLayer(boundingBox& box) const;
 
             /**
-             * @brief Smoothing frame data
+             * @brief Sum up the free and the outside accessible part of the
+             *        circles of the atoms in a z layer, sampling the cells along
+             *        the circles
              * 
              * @param box 
+             * @param z 
              */
-            void smoothFrame(boundingBox& box);
+            void setOutsideArcsOfLayer(boundingBox& box, int z) const;
 
             /**
-             * @brief Find the closest atom to the frame
+             * @brief Digest of the atom coordinates and of the parameters
+             *        the surface depends on, used as cache key
              * 
-             * @param box 
+             * @return std::string 
              */
-            void findClosestAtoms(boundingBox& box);
+            std::string cacheKey() const;
 
             /**
              * @brief Run the solvent accessible surface calculation
              */
             void run();
 
+            /**
+             * @brief Compare the speed and result of the reference and the
+             *        current arc kernel on the selected atoms
+             */
+            void benchmarkArcKernel();
+
+            /**
+             * @brief Compare the speed and accuracy of the Lee-Richards and
+             *        the Shrake-Rupley engine on the selected atoms
+             */
+            void compareEngines();
+
             /**
              * @brief Calculate outside surface (i.e. the surface that is accessible
              *        from outside, needed for beta barrels)
@@ -240,10 +623,25 @@ namespace Tmdet::Utils {
              * @brief Construct a new Surface object
              * 
              * @param protein
+             * @param noCache
+             * @param numThreads (0: number of cores)
+             * @param benchmark run arc kernel benchmark and engine comparison
+             * @param engine LR or SR (TMDET_SURF_ENGINE is used if it is empty)
+             * @param outside calculate outside surface
+             * @param contacts stored contacts of a larger selection
+             * @param symmetric copy surface of a protomer to its symmetry mates
              */
-            explicit Surface(Tmdet::VOs::Protein& protein, bool noCache) : 
+            explicit Surface(Tmdet::VOs::Protein& protein, bool noCache, int numThreads = 1, bool benchmark = false,
+                std::string engine = "", bool outside = false, surfaceContacts* contacts = nullptr,
+                bool symmetric = false) : 
                 protein(protein),
-                noCache(noCache) {
+                noCache(noCache),
+                numThreads(numThreads),
+                benchmark(benchmark),
+                engine(engine),
+                outside(outside),
+                contacts(contacts),
+                symmetric(symmetric) {
                     run();
             }
             
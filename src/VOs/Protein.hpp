@@ -8,6 +8,9 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <gemmi/cifdoc.hpp>
 #include <gemmi/gz.hpp>
 #include <gemmi/cif.hpp>
@@ -238,6 +241,58 @@ namespace Tmdet::VOs {
             }
         }
 
+        /**
+         * @brief run func on the chains in parallel: the longest chains are
+         *        started first and each thread takes the next chain when it
+         *        is ready (chains should be processed independently)
+         *
+         * @param numThreads number of threads (0: number of cores, 1: chains
+         *        are processed sequentially in their original order)
+         * @param selectedOnly skip not selected chains
+         * @param func
+         */
+        template<typename T>
+        void eachChainInParallel(int numThreads, bool selectedOnly, T func) {
+            std::vector<Chain*> list;
+            for(auto& chain: chains) {
+                if (!selectedOnly || chain.selected) {
+                    list.push_back(&chain);
+                }
+            }
+            if (numThreads < 1) {
+                numThreads = (int)std::thread::hardware_concurrency();
+            }
+            numThreads = std::min(numThreads, (int)list.size());
+            if (numThreads <= 1) {
+                for(auto chain: list) {
+                    func(*chain);
+                }
+                return;
+            }
+            std::stable_sort(list.begin(), list.end(),
+                [](const Chain* a, const Chain* b) -> bool { return a->residues.size() > b->residues.size(); });
+            std::atomic<unsigned long int> next = 0;
+            std::vector<std::thread> threads;
+            for (int t=0; t<numThreads; t++) {
+                threads.emplace_back(
+                    [&]() -> void {
+                        unsigned long int i;
+                        while((i = next.fetch_add(1)) < list.size()) {
+                            func(*list[i]);
+                        }
+                    }
+                );
+            }
+            for (auto& thread: threads) {
+                thread.join();
+            }
+        }
+
+        template<typename T>
+        void eachSelectedChainInParallel(int numThreads, T func) {
+            eachChainInParallel(numThreads, true, func);
+        }
+
         template<typename T>
         void eachResidue(T func) {
             for(auto& chain: chains) {
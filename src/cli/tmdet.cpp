@@ -24,9 +24,11 @@
 #include <System/Environment.hpp>
 #include <System/FilePaths.hpp>
 #include <System/Logger.hpp>
+#include <Utils/CellList.hpp>
 #include <Utils/Dssp.hpp>
 #include <Utils/MyDssp.hpp>
 #include <Utils/NeighBors.hpp>
+#include <Utils/SecStrCache.hpp>
 #include <Utils/SecStrVec.hpp>
 #include <VOs/Protein.hpp>
 
@@ -51,13 +53,35 @@ Tmdet::System::Arguments getArguments(int argc, char *argv[]) {
 
     //work 
     args.define(false,true,"cm","curved_membrane","Search for curved membrane","bool","false");
+    args.define(false,true,"cro","curved_radius_optimization","Optimize the sphere radius continuously in curved membrane search","bool","false");
+    args.define(false,true,"cri","curved_radius_iterations","Number of golden-section iterations in sphere radius optimization","int","6");
     args.define(false,true,"dm","duble_membrane","Enable duble membrane mode","bool","false");
     args.define(false,true,"fr","fragment_analysis","Investigate protein domains/fragments separately","bool","false");
+    args.define(false,true,"fc","fragment_contacts","Calculate surface contacts once and derive the surface of fragments from them in fragment analysis","bool","false");
     args.define(false,true,"bi","barrel_inside","Indicate chains those are within a barrel (but not part of barrel, like chain B in 5iv8)","string","");
     args.define(false,true,"ns","no_symmetry","Do not use symmetry axes as membrane normal","bool","false");
     args.define(false,true,"uc","unselect_chains","Unselect proteins chains","string","");
     args.define(false,true,"fa","force_nodel_antibody","Do not unselect antibodies in the structure","bool","false");
     args.define(false,true,"nc","no_cache","Do not use cached data","bool","false");
+    args.define(false,true,"t","threads","Number of threads used in secondary structure definition, surface calculation and membrane normal search (0: number of cores)","int","1");
+    args.define(false,true,"nb","neighbor_benchmark","Compare the speed of gemmi neighbor search and cell list","bool","false");
+    args.define(false,true,"db","dssp_benchmark","Compare the speed of all pairs and grid based hydrogen bond search in dssp","bool","false");
+    args.define(false,true,"nos","no_outside_surface","Use the whole surface instead of the surface accessible from outside in each z layer","bool","false");
+    args.define(false,true,"ss","symmetric_surface","Calculate surface of one protomer of homo-oligomers and copy it to the superposable chains","bool","false");
+    args.define(false,true,"se","surface_engine","Surface engine: LR (Lee-Richards) or SR (Shrake-Rupley), default is TMDET_SURF_ENGINE","string","");
+    args.define(false,true,"sb","surface_benchmark","Compare the speed and accuracy of surface kernels and engines","bool","false");
+    args.define(false,true,"np","no_pruning","Do not skip membrane normals those can not be better than the actual best one","bool","false");
+    args.define(false,true,"lr","local_refinement","Refine the membrane normal by local pattern search after the search","bool","false");
+    args.define(false,true,"lrs","lr_seeds","Number of best directions used as seeds of local refinement","int","3");
+    args.define(false,true,"lrb","lr_budget","Maximum number of membrane normals tested by local refinement, including the seeds (if there are more seeds, only the best ones are refined)","int","200");
+    args.define(false,true,"lrr","lr_resolution","Final angular resolution of local refinement in radian","float","0.01");
+    args.define(false,true,"hs","hierarchical_search","Coarse-to-fine search for membrane normal instead of the exhaustive one","bool","false");
+    args.define(false,true,"hsn","hs_coarse_points","Number of directions in the coarse step of hierarchical search","int","100");
+    args.define(false,true,"hsk","hs_top_k","Number of best coarse directions refined in hierarchical search","int","4");
+    args.define(false,true,"hsr","hs_resolution","Final angular resolution of hierarchical search in radian","float","0.02");
+    args.define(false,true,"hsb","hs_benchmark","Run both exhaustive and hierarchical search and report their speed and results","bool","false");
+    args.define(false,true,"fv","float_validation","Compare the membrane definition with the given reference xml file (e.g. made by the double precision build)","string","");
+    args.define(false,true,"csq","check_smoothing","Check smoothed qValues against the reference implementation","bool","false");
 
     //parameters
     args.define(false,true,"lq","lower_qvalue","Lower qValue, above it is membrane","float","30");
@@ -157,10 +181,26 @@ int main(int argc, char *argv[], char **envp) {
 
     //do the membrane region determination and annotation
     {
-        auto dssp = Tmdet::Utils::Dssp(protein);
-        auto mydssp = Tmdet::Utils::MyDssp(protein);
-        auto ssVec = Tmdet::Utils::SecStrVec(protein);
+        //secondary structure is taken from cache if the backbone is the same
+        auto ssCache = Tmdet::Utils::secStrCache(protein);
+        if (args.getValueAsBool("nc") || args.getValueAsBool("db") || !ssCache.read(protein)) {
+            auto dssp = Tmdet::Utils::Dssp(protein, args.getValueAsInt("t"));
+            if (args.getValueAsBool("db")) {
+                dssp.benchmark();
+            }
+            auto mydssp = Tmdet::Utils::MyDssp(protein, args.getValueAsInt("t"));
+            auto ssVec = Tmdet::Utils::SecStrVec(protein, args.getValueAsInt("t"));
+            if (!args.getValueAsBool("nc") && !args.getValueAsBool("db")) {
+                ssCache.write(protein);
+            }
+        }
+        else {
+            Tmdet::Utils::MyDssp::setCoordinates(protein);
+        }
         Tmdet::Utils::NeighBors::store(protein);
+        if (args.getValueAsBool("nb")) {
+            Tmdet::Utils::CellList::benchmark(protein);
+        }
 
         if (bool fr = args.getValueAsBool("fr"); fr) {
             protein.forceSingleMembrane = true;
@@ -172,6 +212,12 @@ int main(int argc, char *argv[], char **envp) {
         protein.version = Tmdet::version();
         protein.date = Tmdet::System::Date::get();
 
+        //compare membrane definition with the reference if required
+        if (std::string fv = args.getValueAsString("fv"); fv != "") {
+            Tmdet::DTOs::Xml reference;
+            reference.compare(fv, protein);
+        }
+
         //write xml output if required
         if (xmlOutputPath != "") {
             xml.write(xmlOutputPath, protein, args);
@@ -0,0 +1,31 @@
+#!/bin/bash
+# Check that the hierarchical search (-hs) and the local refinement (-lr)
+# result the same membrane normal and qValue with one and with more threads
+# usage: thread-determinism.sh <binary> <output dir> <cif files...>
+
+if [ $# -lt 3 ]; then
+    echo "usage: $0 <binary> <output dir> <cif files...>"
+    exit 1
+fi
+TMDET=$1
+OUT=$2
+shift 2
+mkdir -p "$OUT"
+
+total=0
+different=0
+for cif in "$@"; do
+    name=$(basename "$cif")
+    name=${name%%.*}
+    for mode in hs lr; do
+        "$TMDET" -pi "$cif" -x "$OUT/$name.$mode.t1.xml" -nc -$mode -t 1 > /dev/null 2>&1 || continue
+        "$TMDET" -pi "$cif" -x "$OUT/$name.$mode.t4.xml" -nc -$mode -t 4 > /dev/null 2>&1 || continue
+        total=$((total+1))
+        if ! diff -q <(grep -E "<rowZ|<qValue" "$OUT/$name.$mode.t1.xml") \
+                     <(grep -E "<rowZ|<qValue" "$OUT/$name.$mode.t4.xml") > /dev/null; then
+            different=$((different+1))
+            echo "$name (-$mode): different"
+        fi
+    done
+done
+echo "runs: $total, different membrane normal or qValue: $different"